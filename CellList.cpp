@@ -0,0 +1,59 @@
+#include "CellList.h"
+
+CellList::CellList() : cells(0) {
+  cellStart.assign(1, 0);
+}
+
+void CellList::setCells(int c) {
+  cells = c>0 ? c : 0;
+  cellStart.assign(cells+1, 0);
+  order.clear();
+}
+
+void CellList::build(const vector<int>& cellOf) {
+  int N = cellOf.size();
+  // Count the items in each cell
+  cellStart.assign(cells+1, 0);
+  for (int i=0; i<N; i++) cellStart[cellOf[i]+1]++;
+  // Prefix sum gives the start of each cell
+  for (int c=0; c<cells; c++) cellStart[c+1] += cellStart[c];
+  // Place the items, keeping their relative order within a cell
+  order.resize(N);
+  fill.assign(cellStart.begin(), cellStart.end()-1);
+  for (int i=0; i<N; i++) order[fill[cellOf[i]]++] = i;
+}
+
+void CellList::setSorted() {
+  for (size_t k=0; k<order.size(); k++) order[k] = k;
+}
+
+OverlapGrid::OverlapGrid() : left(0), bottom(0), dx(1), dy(1), nx(1), ny(1), capped(false), items(0), maxRadius(0) {
+  head.assign(1, -1);
+}
+
+void OverlapGrid::setBounds(double l, double r, double b, double t, double cellSize, int maxCells) {
+  left = l; bottom = b;
+  nx = cellSize>0 ? static_cast<int>(ceil((r-l)/cellSize)) : 1;
+  ny = cellSize>0 ? static_cast<int>(ceil((t-b)/cellSize)) : 1;
+  nx = nx<1 ? 1 : nx; ny = ny<1 ? 1 : ny;
+  // Use larger cells if there would be too many
+  capped = static_cast<long>(nx)*ny>maxCells;
+  while (static_cast<long>(nx)*ny>maxCells && (nx>1 || ny>1)) {
+    nx = nx>1 ? nx/2 : 1;
+    ny = ny>1 ? ny/2 : 1;
+  }
+  dx = (r-l)/nx; dy = (t-b)/ny;
+  maxRadius = 0;
+  items = 0;
+  head.assign(nx*ny, -1);
+  next.clear();
+}
+
+void OverlapGrid::insert(int id, vect<> pos, double radius) {
+  int c = cellX(pos.x) + nx*cellY(pos.y);
+  if (id>=static_cast<int>(next.size())) next.resize(id+1, -1);
+  next[id] = head[c];
+  head[c] = id;
+  items++;
+  maxRadius = radius>maxRadius ? radius : maxRadius;
+}
@@ -0,0 +1,95 @@
+/// Header for CellList.h
+/// A cell list built with a counting sort. Instead of one std::list per sector, the items are kept in
+/// a single index array sorted by cell, and cellStart gives where each cell's items begin.
+
+#ifndef CELL_LIST_H
+#define CELL_LIST_H
+
+#include "Utility.h"
+
+class CellList {
+ public:
+  CellList();
+
+  // Set the number of cells (clears the list)
+  void setCells(int);
+
+  // Sort the items into their cells. cellOf[i] is the cell of item i
+  void build(const vector<int>& cellOf);
+
+  // Use the identity ordering (after the items themselves have been put in cell order)
+  void setSorted();
+
+  // Accessors
+  int getCells() { return cells; }
+  int size() { return order.size(); }
+  int begin(int c) { return cellStart[c]; }    // First position of cell c
+  int end(int c) { return cellStart[c+1]; }    // One past the last position of cell c
+  int count(int c) { return cellStart[c+1]-cellStart[c]; }
+  int at(int k) { return order[k]; }           // Item at position k
+  const vector<int>& getOrder() { return order; }
+
+  // Copy items into cell order, sorted[k] = items[order[k]]
+  template<typename T> void gather(const vector<T>& items, vector<T>& sorted) {
+    sorted.resize(order.size());
+    for (size_t k=0; k<order.size(); k++) sorted[k] = items[order[k]];
+  }
+
+ private:
+  int cells;
+  vector<int> cellStart; // Start of each cell's items in order (size cells+1)
+  vector<int> order;     // Item indices, sorted by cell
+  vector<int> fill;      // Next free position in each cell while building
+};
+
+/// A grid that items can be inserted into one at a time (a linked list per cell), for overlap
+/// queries while particles are being placed
+class OverlapGrid {
+ public:
+  OverlapGrid();
+
+  // Set the region and the cell size (at most maxCells cells), and remove all items
+  void setBounds(double left, double right, double bottom, double top, double cellSize, int maxCells);
+
+  // Add item id (ids should be small integers) with the given position and radius
+  void insert(int id, vect<> pos, double radius);
+
+  // Whether the grid was limited to fewer cells than asked for and now has many items per cell
+  bool crowded() { return capped && items>2*nx*ny; }
+
+  // Call hit(id) on every item that could overlap a disc at pos with radius R, stopping (and
+  // returning true) as soon as hit returns true. Items may have moved up to one cell since they were inserted
+  template<typename F> bool search(vect<> pos, double R, F hit) {
+    double reach = R + maxRadius;
+    int x0 = cellX(pos.x-reach)-1, x1 = cellX(pos.x+reach)+1;
+    int y0 = cellY(pos.y-reach)-1, y1 = cellY(pos.y+reach)+1;
+    x0 = x0<0 ? 0 : x0; y0 = y0<0 ? 0 : y0;
+    x1 = x1>=nx ? nx-1 : x1; y1 = y1>=ny ? ny-1 : y1;
+    for (int y=y0; y<=y1; y++)
+      for (int x=x0; x<=x1; x++)
+	for (int i=head[x+nx*y]; i!=-1; i=next[i])
+	  if (hit(i)) return true;
+    return false;
+  }
+
+ private:
+  // Anything outside of the grid goes in the edge cells
+  int cellX(double x) {
+    double X = (x-left)/dx;
+    return X<0 ? 0 : (X>=nx ? nx-1 : static_cast<int>(X));
+  }
+  int cellY(double y) {
+    double Y = (y-bottom)/dy;
+    return Y<0 ? 0 : (Y>=ny ? ny-1 : static_cast<int>(Y));
+  }
+
+  double left, bottom, dx, dy;
+  int nx, ny;
+  bool capped;       // Whether maxCells limited the number of cells
+  int items;         // Number of items inserted
+  double maxRadius;  // Largest radius inserted
+  vector<int> head;  // First item in each cell (-1 for none)
+  vector<int> next;  // Next item in the same cell
+};
+
+#endif
@@ -0,0 +1,47 @@
+/// Header for Checkpoint.h
+/// Helpers for writing and reading the binary checkpoint files (raw host byte order, so a checkpoint
+/// is meant to be restarted on the same kind of machine that wrote it).
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Utility.h"
+#include <cstdint>
+#include <fstream>
+
+/// Exception class
+class BadCheckpointFile {};
+
+template<typename T> inline void writeBinary(std::ostream& out, const T& x) {
+  out.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+template<typename T> inline void readBinary(std::istream& in, T& x) {
+  if (!in.read(reinterpret_cast<char*>(&x), sizeof(T))) throw BadCheckpointFile();
+}
+
+inline void writeBinary(std::ostream& out, const string& s) {
+  writeBinary(out, static_cast<uint64_t>(s.size()));
+  out.write(s.data(), s.size());
+}
+
+inline void readBinary(std::istream& in, string& s) {
+  uint64_t size;
+  readBinary(in, size);
+  s.resize(size);
+  if (size>0 && !in.read(&s[0], size)) throw BadCheckpointFile();
+}
+
+template<typename T> inline void writeBinary(std::ostream& out, const vector<T>& v) {
+  writeBinary(out, static_cast<uint64_t>(v.size()));
+  for (const auto& x : v) writeBinary(out, x);
+}
+
+template<typename T> inline void readBinary(std::istream& in, vector<T>& v) {
+  uint64_t size;
+  readBinary(in, size);
+  v.resize(size);
+  for (auto& x : v) readBinary(in, x);
+}
+
+#endif
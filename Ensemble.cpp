@@ -0,0 +1,112 @@
+#include "Ensemble.h"
+
+Ensemble::Ensemble() : width(4.), height(2.), radius(0.05), time(20.), startRecording(3.), runTime(0) {
+  phis.push_back(0.5);
+  actives.push_back(0.);
+  forces.push_back(default_run_force);
+  velocities.push_back(1.);
+  seeds.push_back(1);
+  nThreads = std::thread::hardware_concurrency();
+  if (nThreads<1) nThreads = 1;
+}
+
+void Ensemble::setTrials(int n, uint64_t first) {
+  seeds.clear();
+  for (int i=0; i<n; i++) seeds.push_back(first+i);
+}
+
+void Ensemble::run() {
+  // Every combination of parameters, seeds varying fastest so each point's runs are adjacent
+  points.clear();
+  for (auto p : phis)
+    for (auto a : actives)
+      for (auto f : forces)
+	for (auto v : velocities)
+	  for (auto s : seeds) {
+	    EnsemblePoint P = {p, a, f, v, s};
+	    points.push_back(P);
+	  }
+  results = vector<vector<RunningStat> >(points.size()/seeds.size(), vector<RunningStat>(statistics.size()));
+  // Deal the jobs out round robin, so every thread starts with a spread of sizes
+  int threads = min(nThreads, static_cast<int>(points.size()));
+  queues = vector<std::deque<int> >(threads);
+  vector<std::mutex>(threads).swap(queueLocks);
+  for (size_t i=0; i<points.size(); i++) queues[i%threads].push_back(i);
+  // Run
+  double start = omp_get_wtime();
+  vector<std::thread> workers;
+  for (int t=0; t<threads; t++) workers.push_back(std::thread(&Ensemble::worker, this, t));
+  for (auto &w : workers) w.join();
+  runTime = omp_get_wtime()-start;
+}
+
+void Ensemble::write(string filename) {
+  std::ofstream out(filename);
+  if (!out) throw BadOutputFile();
+  write(out);
+}
+
+void Ensemble::write(std::ostream& out) {
+  out << "phi\tactive\tforce\tvelocity\truns";
+  for (auto S : statistics) out << '\t' << S.second << "\t" << S.second << "_var";
+  out << '\n';
+  for (size_t i=0; i<results.size(); i++) {
+    EnsemblePoint P = getPoint(i);
+    out << P.phi << '\t' << P.active << '\t' << P.force << '\t' << P.velocity << '\t' << (results[i].empty() ? 0 : results[i][0].n);
+    for (auto R : results[i]) out << '\t' << R.mean << '\t' << R.variance();
+    out << '\n';
+  }
+}
+
+inline void Ensemble::runJob(int j) {
+  const EnsemblePoint &P = points[j];
+  // Each run draws from a stream keyed by its own seed and numbers its particles from zero, so it
+  // gives the same result whichever thread it lands on
+  seedThreadRandom(P.seed);
+  Simulator simulation;
+  simulation.setAsyncRecording(false); // The other cores are busy with other runs
+  for (auto S : statistics) simulation.addStatistic(S.first);
+  simulation.setStartRecording(startRecording);
+  if (setup) setup(simulation, P);
+  else defaultSetup(simulation, P);
+  simulation.run(time);
+  // Fold the time averages into the point's results
+  vector<double> averages;
+  for (size_t i=0; i<statistics.size(); i++) averages.push_back(simulation.getStatSummary(i).mean());
+  std::lock_guard<std::mutex> lock(resultLock);
+  for (size_t i=0; i<averages.size(); i++) results[j/seeds.size()][i].add(averages[i]);
+}
+
+inline void Ensemble::worker(int t) {
+  int job;
+  while (takeJob(t, job)) runJob(job);
+}
+
+inline bool Ensemble::takeJob(int t, int& job) {
+  // Take from the back of our own queue
+  {
+    std::lock_guard<std::mutex> lock(queueLocks[t]);
+    if (!queues[t].empty()) {
+      job = queues[t].back();
+      queues[t].pop_back();
+      return true;
+    }
+  }
+  // Steal from the front of someone else's
+  for (size_t i=1; i<queues.size(); i++) {
+    int v = (t+i)%queues.size();
+    std::lock_guard<std::mutex> lock(queueLocks[v]);
+    if (!queues[v].empty()) {
+      job = queues[v].front();
+      queues[v].pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void Ensemble::defaultSetup(Simulator& simulation, const EnsemblePoint& P) {
+  int number = width*height/(PI*sqr(radius))*P.phi;
+  int NA = number*P.active, NP = number-NA;
+  simulation.createControlPipe(NP, NA, radius, P.velocity, P.force, radius, width, height);
+}
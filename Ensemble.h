@@ -0,0 +1,79 @@
+/// Header for Ensemble.h
+/// Runs many independent simulations over a grid of parameters, spread across threads with
+/// work stealing. The time average of each statistic is taken for every run, and the mean and
+/// variance over the runs at each parameter point are accumulated online.
+
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "Simulator.h"
+#include <deque>
+
+/// The parameters of one run
+struct EnsemblePoint {
+  double phi;      // Packing density
+  double active;   // Fraction of active particles
+  double force;    // Active force
+  double velocity; // Fluid velocity
+  uint64_t seed;   // Random seed
+};
+
+class Ensemble {
+ public:
+  Ensemble();
+
+  // The parameter grid (every combination is run)
+  void setPhi(vector<double> p) { phis = p; }
+  void setActive(vector<double> a) { actives = a; }
+  void setForce(vector<double> f) { forces = f; }
+  void setVelocity(vector<double> v) { velocities = v; }
+  void setSeeds(vector<uint64_t> s) { seeds = s; }
+  void setTrials(int n, uint64_t first=1); // Seeds first, first+1, ...
+
+  // Run settings
+  void setDimensions(double w, double h) { width = w; height = h; }
+  void setRadius(double r) { radius = r; }
+  void setTime(double t) { time = t; }
+  void setStartRecording(double t) { startRecording = t; }
+  void setThreads(int n) { nThreads = n>0 ? n : 1; }
+  void addStatistic(statfunc f, string name) { statistics.push_back(pair<statfunc,string>(f, name)); }
+  // Replaces the default setup (a control pipe), called on a fresh simulator after seeding
+  void setSetup(std::function<void(Simulator&, const EnsemblePoint&)> s) { setup = s; }
+
+  void run();
+
+  // Results, one row per parameter point (seeds are averaged over)
+  int size() { return results.size(); }
+  EnsemblePoint getPoint(int i) { return points.at(i*seeds.size()); }
+  RunningStat getResult(int i, int stat) { return results.at(i).at(stat); }
+  void write(string filename); // Tab separated table
+  void write(std::ostream&);
+  double getRunTime() { return runTime; }
+
+  // Exception classes
+  class BadOutputFile {};
+
+ private:
+  inline void runJob(int); // Run one simulation and fold its statistics into the results
+  inline void worker(int); // Take jobs from this thread's queue, steal when it is empty
+  inline bool takeJob(int, int&);
+  inline void defaultSetup(Simulator&, const EnsemblePoint&);
+
+  /// Parameters
+  vector<double> phis, actives, forces, velocities;
+  vector<uint64_t> seeds;
+  double width, height, radius, time, startRecording;
+  int nThreads;
+  vector<pair<statfunc,string> > statistics;
+  std::function<void(Simulator&, const EnsemblePoint&)> setup;
+
+  /// Jobs and results
+  vector<EnsemblePoint> points; // Every run, seeds vary fastest
+  vector<std::deque<int> > queues; // Each thread's jobs
+  vector<std::mutex> queueLocks;
+  vector<vector<RunningStat> > results; // [parameter point][statistic]
+  std::mutex resultLock;
+  double runTime;
+};
+
+#endif
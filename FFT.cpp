@@ -0,0 +1,188 @@
+#include "FFT.h"
+
+FFT::FFT(int n) : n(0) {
+  setLength(n);
+}
+
+void FFT::setLength(int length) {
+  n = length;
+  factors.clear();
+  int m = n;
+  while (m>1 && m%4==0) { factors.push_back(4); m /= 4; }
+  while (m>1 && m%2==0) { factors.push_back(2); m /= 2; }
+  for (int p=3; p<=m; p+=2)
+    while (m%p==0) { factors.push_back(p); m /= p; }
+  twiddle.resize(n);
+  shift.resize(n);
+  for (int k=0; k<n; k++) {
+    twiddle[k] = std::polar(1., -2*fft_pi*k/n);
+    shift[k] = std::polar(1., -fft_pi*k/(2*n));
+  }
+  work.resize(n);
+  temp.resize(n);
+  // Set up Bluestein's algorithm if there is a large prime factor
+  chirpFFT.reset();
+  if (!factors.empty() && fft_max_radix<factors.back()) {
+    int M = 1;
+    while (M<2*n-1) M *= 2;
+    chirpFFT = std::make_shared<FFT>(M);
+    chirp.resize(n);
+    kernel.assign(M, 0);
+    pad.resize(M);
+    for (long k=0; k<n; k++) {
+      chirp[k] = std::polar(1., -fft_pi*((k*k)%(2*n))/n); // k^2 mod 2n keeps the phase exact
+      kernel[k] = conj(chirp[k]);
+      if (k>0) kernel[M-k] = conj(chirp[k]);
+    }
+    chirpFFT->forward(&kernel[0]);
+  }
+}
+
+/// The transforms of the two real lines packed into work, at frequency k
+inline void FFT::spectra(int k, cplx& A, cplx& B) const {
+  cplx Z = work[k], W = conj(work[k==0 ? 0 : n-k]);
+  A = 0.5*(Z+W);
+  B = cplx(0,-0.5)*(Z-W);
+}
+
+void FFT::forward(cplx* data) {
+  if (n<2) return;
+  if (chirpFFT) {
+    chirpTransform(data);
+    return;
+  }
+  for (int i=0; i<n; i++) temp[i] = data[i];
+  transform(&temp[0], data, n, 1, 0);
+}
+
+void FFT::inverse(cplx* data) {
+  if (n<2) return;
+  // The inverse is the forward transform of the conjugate, conjugated
+  for (int i=0; i<n; i++) data[i] = conj(data[i]);
+  forward(data);
+  double norm = 1./n;
+  for (int i=0; i<n; i++) data[i] = norm*conj(data[i]);
+}
+
+void FFT::realForward(double* a, double* b) {
+  pack(a, b);
+  forward(&work[0]);
+  for (int k=0; k<=n/2; k++) {
+    cplx A, B;
+    spectra(k, A, B);
+    a[k] = A.real();
+    if (b) b[k] = B.real();
+    if (0<k && k<n-k) {
+      a[n-k] = A.imag();
+      if (b) b[n-k] = B.imag();
+    }
+  }
+}
+
+void FFT::realInverse(double* a, double* b) {
+  // Rebuild the full spectra (they are Hermitian) and pack them as A + iB
+  for (int k=0; k<=n/2; k++) {
+    cplx A(a[k], 0<k && k<n-k ? a[n-k] : 0), B;
+    if (b) B = cplx(b[k], 0<k && k<n-k ? b[n-k] : 0);
+    work[k] = A + cplx(0,1)*B;
+    if (0<k && k<n-k) work[n-k] = conj(A) + cplx(0,1)*conj(B);
+  }
+  inverse(&work[0]);
+  unpack(a, b);
+}
+
+void FFT::cosineForward(double* a, double* b) {
+  // Even entries in order, then odd entries in reverse
+  for (int j=0; 2*j<n; j++) {
+    temp[j] = cplx(a[2*j], b ? b[2*j] : 0);
+    if (2*j+1<n) temp[n-1-j] = cplx(a[2*j+1], b ? b[2*j+1] : 0);
+  }
+  for (int i=0; i<n; i++) work[i] = temp[i];
+  forward(&work[0]);
+  for (int k=0; k<n; k++) {
+    cplx A, B;
+    spectra(k, A, B);
+    temp[k] = cplx((shift[k]*A).real(), (shift[k]*B).real());
+  }
+  for (int k=0; k<n; k++) {
+    a[k] = temp[k].real();
+    if (b) b[k] = temp[k].imag();
+  }
+}
+
+void FFT::cosineInverse(double* a, double* b) {
+  // V_k = exp(i pi k/2n) (X_k - i X_{n-k}), with X_n = 0
+  for (int k=0; k<n; k++) {
+    cplx A = conj(shift[k])*cplx(a[k], k>0 ? -a[n-k] : 0), B;
+    if (b) B = conj(shift[k])*cplx(b[k], k>0 ? -b[n-k] : 0);
+    work[k] = A + cplx(0,1)*B;
+  }
+  inverse(&work[0]);
+  for (int j=0; 2*j<n; j++) {
+    a[2*j] = work[j].real();
+    if (b) b[2*j] = work[j].imag();
+    if (2*j+1<n) {
+      a[2*j+1] = work[n-1-j].real();
+      if (b) b[2*j+1] = work[n-1-j].imag();
+    }
+  }
+}
+
+void FFT::transform(const cplx* in, cplx* out, int length, int stride, int f) {
+  if (length==1) {
+    out[0] = in[0];
+    return;
+  }
+  // Transform the p decimated sequences, then combine them
+  int p = factors[f], m = length/p;
+  for (int q=0; q<p; q++) transform(in+q*stride, out+q*m, m, stride*p, f+1);
+  if (p==2)
+    for (int k=0; k<m; k++) {
+      cplx t0 = out[k], t1 = out[k+m]*twiddle[k*stride];
+      out[k] = t0+t1;
+      out[k+m] = t0-t1;
+    }
+  else if (p==4)
+    for (int k=0; k<m; k++) {
+      cplx a = out[k], b = out[k+m]*twiddle[k*stride];
+      cplx c = out[k+2*m]*twiddle[2*k*stride], d = out[k+3*m]*twiddle[3*k*stride];
+      cplx apc = a+c, amc = a-c, bpd = b+d, bmd = cplx(0,-1)*(b-d);
+      out[k] = apc+bpd;
+      out[k+m] = amc+bmd;
+      out[k+2*m] = apc-bpd;
+      out[k+3*m] = amc-bmd;
+    }
+  else {
+    vector<cplx> t(p);
+    int root = n/p; // exp(-2 pi i/p) is twiddle[root]
+    for (int k=0; k<m; k++) {
+      for (int q=0; q<p; q++) t[q] = out[k+q*m]*twiddle[q*k*stride];
+      for (int r=0; r<p; r++) {
+        cplx sum = 0;
+        for (int q=0; q<p; q++) sum += t[q]*twiddle[(q*r)%p*root];
+        out[k+r*m] = sum;
+      }
+    }
+  }
+}
+
+/// X_k = chirp_k sum_j (x_j chirp_j) conj(chirp_{k-j}), since jk = (j^2 + k^2 - (k-j)^2)/2
+void FFT::chirpTransform(cplx* data) {
+  int M = pad.size();
+  for (int j=0; j<M; j++) pad[j] = j<n ? data[j]*chirp[j] : 0;
+  chirpFFT->forward(&pad[0]);
+  for (int j=0; j<M; j++) pad[j] *= kernel[j];
+  chirpFFT->inverse(&pad[0]);
+  for (int k=0; k<n; k++) data[k] = chirp[k]*pad[k];
+}
+
+void FFT::pack(const double* a, const double* b) {
+  for (int i=0; i<n; i++) work[i] = cplx(a[i], b ? b[i] : 0);
+}
+
+void FFT::unpack(double* a, double* b) {
+  for (int i=0; i<n; i++) {
+    a[i] = work[i].real();
+    if (b) b[i] = work[i].imag();
+  }
+}
@@ -0,0 +1,69 @@
+/// Mixed radix fast Fourier transform, with the real and cosine transforms built on it
+///
+
+#ifndef FFT_H
+#define FFT_H
+
+#include "Utility.h"
+#include <complex>
+#include <memory>
+
+typedef std::complex<double> cplx;
+
+/// PI is only good to 1e-9, which would limit the accuracy of the transforms
+const double fft_pi = 3.14159265358979323846;
+
+/// Largest prime factor that is transformed directly. Lengths with larger prime factors are done as
+/// a convolution with a power of two transform (Bluestein's algorithm), so every length is O(n log n)
+const int fft_max_radix = 32;
+
+/// Transforms of one length. The length is split into factors of 4, 2, 3, 5 and then any other primes.
+///
+/// The real transforms take two lines at once, packed into one complex transform as a + ib, so a real
+/// line costs half a complex one. The Fourier transform of a real line is stored in half complex order:
+/// Re X_0, Re X_1, ..., Re X_{n/2}, Im X_{(n-1)/2}, ..., Im X_1. Then every entry belongs to a frequency
+/// (k or n-k) and any real, even multiplier acts entry by entry. The cosine transform is the DCT-II,
+/// done with one complex transform of the same length (Makhoul's reordering). Inverses are normalized.
+class FFT {
+ public:
+  FFT(int n=0);
+
+  void setLength(int);
+  int getLength() const { return n; }
+
+  // Complex transforms, in place
+  void forward(cplx*);
+  void inverse(cplx*);
+
+  // Real transforms of two lines, in place. The second line may be null
+  void realForward(double* a, double* b);
+  void realInverse(double* a, double* b);
+  void cosineForward(double* a, double* b);
+  void cosineInverse(double* a, double* b);
+
+  // The frequency that entry i of a half complex line belongs to
+  int frequency(int i) const { return i<=n/2 ? i : n-i; }
+
+ private:
+  /// Helper functions
+  void transform(const cplx* in, cplx* out, int length, int stride, int factor);
+  void chirpTransform(cplx*);
+  void pack(const double* a, const double* b);
+  void unpack(double* a, double* b);
+  inline void spectra(int k, cplx& A, cplx& B) const;
+
+  /// Data
+  int n;
+  vector<int> factors;
+  vector<cplx> twiddle; // exp(-2 pi i k/n)
+  vector<cplx> shift;   // exp(-i pi k/2n), for the cosine transform
+  vector<cplx> work, temp; // Packed lines, and a copy for the out of place transform
+
+  // For Bluestein's algorithm
+  std::shared_ptr<FFT> chirpFFT; // Power of two transform for the convolution, if needed
+  vector<cplx> chirp;  // exp(-i pi k^2/n)
+  vector<cplx> kernel; // Transform of the conjugate chirp, wrapped around
+  vector<cplx> pad;
+};
+
+#endif // FFT_H
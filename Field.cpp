@@ -78,6 +78,105 @@ void delSqr(const Field& field, Field& buffer) {
 
 }
 
+void Field::spectralSolver(Field& source, double mult) {
+  // Check that the source field has the same dimensions
+  matches(&source);
+  if (anyLocks()) {
+    MG_solver(source, mult);
+    return;
+  }
+  // The zero mode has no equation, so it keeps its value, which is the sum over the region
+  loadSpectrum(array);
+  double sum = 0;
+  for (auto v : spectrum) sum += v;
+  loadSpectrum(source.array);
+  transform(false);
+  for (int y=0; y<my; y++)
+    for (int x=0; x<mx; x++) {
+      double lambda = eigenvalue(x,y);
+      spectrum[x+mx*y] = lambda!=0 ? mult*spectrum[x+mx*y]/lambda : sum;
+    }
+  transform(true);
+  storeSpectrum();
+}
+
+void Field::implicitDiffusion(double D, double dt) {
+  if (anyLocks()) throw SpectralLocks();
+  loadSpectrum(array);
+  transform(false);
+  for (int y=0; y<my; y++)
+    for (int x=0; x<mx; x++)
+      spectrum[x+mx*y] /= 1-dt*D*eigenvalue(x,y);
+  transform(true);
+  storeSpectrum();
+}
+
+bool Field::anyLocks() const {
+  if (!usesLocks || !locks) return false;
+  for (int i=0; i<dX*dY; i++)
+    if (locks[i]) return true;
+  return false;
+}
+
+/// Copy the solved region into the spectrum buffer, and set up the transforms for its size
+void Field::loadSpectrum(const double* data) {
+  sx = wrapX ? 0 : 1; mx = wrapX ? dX : dX-2;
+  sy = wrapY ? 0 : 1; my = wrapY ? dY : dY-2;
+  if (fftX.getLength()!=mx) fftX.setLength(mx);
+  if (fftY.getLength()!=my) fftY.setLength(my);
+  spectrum.resize(mx*my);
+  column.resize(2*my);
+  for (int y=0; y<my; y++)
+    for (int x=0; x<mx; x++)
+      spectrum[x+mx*y] = data[(x+sx)+dX*(y+sy)];
+}
+
+/// Copy the solved region back, and copy the edges that don't wrap from their neighbours
+void Field::storeSpectrum() {
+  for (int y=0; y<my; y++)
+    for (int x=0; x<mx; x++)
+      array[(x+sx)+dX*(y+sy)] = spectrum[x+mx*y];
+  if (!wrapY)
+    for (int x=0; x<dX; x++) {
+      at(x,0) = at(x,1);
+      at(x,dY-1) = at(x,dY-2);
+    }
+  if (!wrapX)
+    for (int y=0; y<dY; y++) {
+      at(0,y) = at(1,y);
+      at(dX-1,y) = at(dX-2,y);
+    }
+}
+
+/// Transform the rows, then the columns, two lines at a time
+void Field::transform(bool inverse) {
+  auto line = [&] (FFT& fft, bool wrap, double* a, double* b) {
+    if (wrap) inverse ? fft.realInverse(a,b) : fft.realForward(a,b);
+    else inverse ? fft.cosineInverse(a,b) : fft.cosineForward(a,b);
+  };
+  for (int y=0; y<my; y+=2)
+    line(fftX, wrapX, &spectrum[mx*y], y+1<my ? &spectrum[mx*(y+1)] : 0);
+  for (int x=0; x<mx; x+=2) {
+    bool pair = x+1<mx;
+    for (int y=0; y<my; y++) {
+      column[y] = spectrum[x+mx*y];
+      if (pair) column[my+y] = spectrum[x+1+mx*y];
+    }
+    line(fftY, wrapY, &column[0], pair ? &column[my] : 0);
+    for (int y=0; y<my; y++) {
+      spectrum[x+mx*y] = column[y];
+      if (pair) spectrum[x+1+mx*y] = column[my+y];
+    }
+  }
+}
+
+/// Eigenvalue of the five point Laplacian for a spectrum entry
+double Field::eigenvalue(int x, int y) {
+  double kx = wrapX ? (double)fftX.frequency(x)/mx : 0.5*x/mx;
+  double ky = wrapY ? (double)fftY.frequency(y)/my : 0.5*y/my;
+  return -4*(sqr(invDist.x*sin(fft_pi*kx)) + sqr(invDist.y*sin(fft_pi*ky)));
+}
+
 //***** VField Functions *****
 
 VField::VField() : FieldBase< vect<> >() {};
@@ -2,6 +2,7 @@
 #define FIELD_H
 
 #include "FieldBase.h"
+#include "FFT.h"
 
 class VField;
 
@@ -23,6 +24,28 @@ class Field : public FieldBase<double> {
   friend void grad(Field& field, VField& vfield);
   double delSqr(int,int) const;
   friend void delSqr(const Field& field, Field&);
+
+  // Spectral solvers. Each axis is transformed with the Fourier transform if it wraps, and with the
+  // cosine transform if it doesn't, which gives the insulating edges of SOR_solver. Both solve the
+  // same five point equations as the other solvers, exactly
+  void spectralSolver(Field& source, double=1); // Solves delSqr = mult*source, keeping the mean
+  void implicitDiffusion(double D, double dt);  // One backward Euler step of d/dt = D*delSqr
+
+  /// Exception classes
+  struct SpectralLocks {}; // Locked points can't be kept by a spectral solve
+
+ private:
+  /// Helper functions
+  bool anyLocks() const;
+  void loadSpectrum(const double*);
+  void storeSpectrum();
+  void transform(bool inverse);
+  double eigenvalue(int, int);
+
+  /// Data
+  FFT fftX, fftY;
+  vector<double> spectrum, column; // The solved region (edges that don't wrap are left out)
+  int sx, sy, mx, my;              // Where the solved region starts, and its size
 };
 
 /// A vector field type
@@ -58,6 +58,7 @@ FieldBase<T>& FieldBase<T>::operator=(FieldBase<T>& field) {
   for (int y=0; y<dY; y++)
     for (int x=0; x<dX; x++)
       at(x,y) = field.at(x,y);
+  return *this;
 }
 
 template<typename T>
@@ -101,7 +102,7 @@ template<typename T>
 void FieldBase<T>::setWrapY(bool w) {
   wrapY = w;
   if (w) invDist.y = 1./((top-bottom)/dY);
-  else 1./((top-bottom)/(dY-1));
+  else invDist.y = 1./((top-bottom)/(dY-1));
   LFactor = 2*(sqr(invDist.x)+sqr(invDist.y));
   invLFactor = 1./LFactor;
 }
@@ -194,7 +195,7 @@ T& FieldBase<T>::operator()(int x, int y) {
 
 template<typename T>
 T FieldBase<T>::at(vect<> pos, bool thrw) const {
-  return operator(pos, thrw);
+  return operator()(pos, thrw);
 }
 
 template<typename T>
@@ -390,6 +391,36 @@ void FieldBase<T>::createLocks() {
   for (int i=0; i<dX*dY; i++) locks[i] = false;
 }
 
+template<typename T>
+void FieldBase<T>::save(std::ostream& out) const {
+  writeBinary(out, dX); writeBinary(out, dY);
+  writeBinary(out, left); writeBinary(out, right); writeBinary(out, bottom); writeBinary(out, top);
+  writeBinary(out, invDist); writeBinary(out, LFactor); writeBinary(out, invLFactor);
+  writeBinary(out, wrapX); writeBinary(out, wrapY);
+  writeBinary(out, solveIterations); writeBinary(out, tollerance);
+  writeBinary(out, usesLocks);
+  for (int i=0; i<dX*dY; i++) writeBinary(out, array[i]);
+  if (usesLocks)
+    for (int i=0; i<dX*dY; i++) writeBinary(out, locks ? locks[i] : false);
+}
+
+template<typename T>
+void FieldBase<T>::load(std::istream& in) {
+  readBinary(in, dX); readBinary(in, dY);
+  readBinary(in, left); readBinary(in, right); readBinary(in, bottom); readBinary(in, top);
+  readBinary(in, invDist); readBinary(in, LFactor); readBinary(in, invLFactor);
+  readBinary(in, wrapX); readBinary(in, wrapY);
+  readBinary(in, solveIterations); readBinary(in, tollerance);
+  readBinary(in, usesLocks);
+  if (array) delete [] array;
+  array = dX*dY>0 ? new T[dX*dY] : 0;
+  for (int i=0; i<dX*dY; i++) readBinary(in, array[i]);
+  if (usesLocks) {
+    createLocks();
+    for (int i=0; i<dX*dY; i++) readBinary(in, locks[i]);
+  }
+}
+
 /// Successive Over-Relaxation (SOR) using checkerboard updating with no source
 template<typename T>
 void FieldBase<T>::SOR_solver() {
@@ -487,6 +518,56 @@ void FieldBase<T>::SOR_solver(FieldBase& source, double mult) {
   }
 }
 
+/// Geometric multigrid with no source
+template<typename T>
+void FieldBase<T>::MG_solver() {
+  MG_solve(0, 0);
+}
+
+/// Geometric multigrid with source
+template<typename T>
+void FieldBase<T>::MG_solver(FieldBase& source, double mult) {
+  // Check that the source field has the same dimensions
+  matches(&source);
+  MG_solve(&source, mult);
+}
+
+/// Solves the same equations as the SOR solver: locked points keep their values, and the edges that
+/// don't wrap are copied from their neighbours, so they insulate
+template<typename T>
+void FieldBase<T>::MG_solve(FieldBase* source, double mult) {
+  vector<char> mask(dX*dY, MG_FREE);
+  vector<double> p(dX*dY), f(dX*dY, 0);
+  for (int y=0; y<dY; y++)
+    for (int x=0; x<dX; x++) {
+      int i = x+dX*y;
+      bool edge = (!wrapX && (x==0 || x==dX-1)) || (!wrapY && (y==0 || y==dY-1));
+      if (usesLocks && locks[i]) mask[i] = MG_FIXED;
+      else if (edge) mask[i] = MG_EXCLUDED;
+      p[i] = array[i];
+      if (source) f[i] = mult*source->array[i];
+    }
+  multigrid.setTolerance(tollerance);
+  multigrid.setMaxCycles(solveIterations);
+  // The levels only depend on the mask and the grid, so they are kept until those change
+  if (!multigrid.isSetUp(dX, dY, sqr(invDist.x), sqr(invDist.y), mask, wrapX, wrapY))
+    multigrid.setup(dX, dY, sqr(invDist.x), sqr(invDist.y), mask, wrapX, wrapY);
+  multigrid.solve(&p[0], &f[0]);
+  for (int i=0; i<dX*dY; i++)
+    if (mask[i]==MG_FREE) array[i] = p[i];
+  // Boundaries
+  if (!wrapY)
+    for (int x=0; x<dX; x++) {
+      if (!usesLocks || !lockAt(x,0)) at(x,0) = at(x,1);
+      if (!usesLocks || !lockAt(x,dY-1)) at(x,dY-1) = at(x,dY-2);
+    }
+  if (!wrapX)
+    for (int y=0; y<dY; y++) {
+      if (!usesLocks || !lockAt(0,y)) at(0,y) = at(1,y);
+      if (!usesLocks || !lockAt(dX-1,y)) at(dX-1,y) = at(dX-2,y);
+    }
+}
+
 template<typename T>
 void FieldBase<T>::correctPos(vect<>& pos) const {
   double width = right-left, height = top-bottom;
@@ -513,4 +594,5 @@ template<typename T>
 template<typename S>
 bool FieldBase<T>::matches(const FieldBase<S> *A) const{
   if (A->getDX()!=dX || A->getDY()!=dY) throw FieldMismatch();
+  return true;
 }
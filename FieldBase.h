@@ -2,6 +2,8 @@
 #define FIELDBASE_H
 
 #include "Utility.h"
+#include "Checkpoint.h"
+#include "Multigrid.h"
 
 template<typename T> class FieldBase {
  public:
@@ -26,6 +28,7 @@ template<typename T> class FieldBase {
   int getDY() const { return dY; }
   bool getWrapX() { return wrapX; }
   bool getWrapY() { return wrapY; }
+  int getCycles() const { return multigrid.getCycles(); } // Cycles used by the last multigrid solve
   vect<> getPos(int x, int y) const; // Gets the spatial position at a grid point
 
   // Printing functions
@@ -40,6 +43,8 @@ template<typename T> class FieldBase {
   void setWrap(bool x, bool y);
   void setTollerance(double t) { tollerance = t; }
   void setMaxIters(int i) { solveIterations = i; }
+  void setCycleType(CycleType c) { multigrid.setCycleType(c); }
+  void setAccelerate(bool a) { multigrid.setAccelerate(a); } // False runs plain multigrid cycles, true uses them to precondition conjugate gradient
   void setEdges(double x);
   void setEdge(int edge, double x, bool lock=true);
   void setAll(const T& value);
@@ -51,6 +56,10 @@ template<typename T> class FieldBase {
   bool lockAt(int x, int y) const;
   void lockEdges(bool l);
 
+  // Checkpointing
+  void save(std::ostream&) const;
+  void load(std::istream&);
+
   // Arithmetic
   FieldBase operator+=(T x);
   void plusEq(FieldBase& field, double=1);
@@ -65,6 +74,8 @@ template<typename T> class FieldBase {
   // Solvers
   void SOR_solver();
   void SOR_solver(FieldBase& source, double=1);
+  void MG_solver();
+  void MG_solver(FieldBase& source, double=1);
 
   /// Exception classes
   struct FieldMismatch {};
@@ -85,6 +96,7 @@ template<typename T> class FieldBase {
   void correctPos(vect<>& pos) const;
   bool checkPos(const vect<> pos, bool thrw=true) const;
   template<typename S> bool matches(const FieldBase<S>* B) const;
+  void MG_solve(FieldBase* source, double mult);
 
   /// Data
   int dX, dY;
@@ -95,9 +107,10 @@ template<typename T> class FieldBase {
   bool wrapX, wrapY;
   T* array;
 
-  // For SOR
+  // For SOR (and multigrid, where they bound the cycles and the relative residual)
   int solveIterations;
   double tollerance;
+  Multigrid multigrid;
 
   // For locking
   bool usesLocks; // Whether there are locks or not
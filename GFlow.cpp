@@ -9,7 +9,8 @@ GFlow::GFlow(int x, int y) : MAC(x,y) {
   // Set up particle interaction sectorization
   ssecInteract = false;
   secX = 10; secY = 10;
-  sectors = new list<Particle*>[(secX+2)*(secY+2)+1];
+  sectors.setCells((secX+2)*(secY+2)+1);
+  overlapDirty = true;
   // Number of pressure samples to take
   pSamples = 10;
   // Set up array of normal vectors
@@ -19,7 +20,6 @@ GFlow::GFlow(int x, int y) : MAC(x,y) {
 }
 
 GFlow::~GFlow() {
-  safe_delete(sectors);
   for (auto P : particles) delete P;
   for (auto W : walls) delete W;
 }
@@ -34,8 +34,11 @@ void GFlow::addTempWall(Wall* wall, double duration) {
 }
 
 void GFlow::addParticle(Particle* particle) {
-  int sec = getSec(particle->getPosition());
-  sectors[sec].push_back(particle);
+  // Keep the overlap grid up to date, so placing many particles stays linear
+  if (!overlapDirty) {
+    overlapGrid.insert(particles.size(), particle->getPosition(), particle->getRadius());
+    if (overlapGrid.crowded()) overlapDirty = true;
+  }
   particles.push_back(particle);
 }
 
@@ -46,9 +49,9 @@ void GFlow::addParticles(int N, double R, double var, double lft, double rght, d
   double diffX = rght - lft - 2*R;
   double diffY = tp - bttm - 2*R;
   while (count<N && C) {
-    vect<> pos(lft+diffX*drand48()+R, bttm+diffY*drand48()+R);
+    vect<> pos(lft+diffX*getRand()+R, bttm+diffY*getRand()+R);
     if (!wouldOverlap(pos, R)) {
-      double rad = R*(1+var*drand48());
+      double rad = R*(1+var*getRand());
       Particle *P;
       switch (type) {
       default:
@@ -60,6 +63,10 @@ void GFlow::addParticles(int N, double R, double var, double lft, double rght, d
         P = new RTSphere(pos, rad);
         break;
       }
+      case BACTERIA: {
+        P = new Bacteria(pos, rad);
+        break;
+      }
       }
       //if (watched) addWatchedParticle(P);
       /*else*/ addParticle(P);
@@ -132,6 +139,7 @@ inline void GFlow::initialize() {
   MAC::initialize();
   int size = particles.size();
   if (recPos && size>0) posRec = vector<vector<vect<> > >(particles.size());
+  updateSectors();
   particleBC();
 }
 
@@ -146,6 +154,7 @@ inline void GFlow::updates(double epsilon) {
   interactions();
   updateParticles();
   updateSectors();
+  overlapDirty = true;
   particleBC();
 }
 
@@ -203,45 +212,50 @@ inline void GFlow::record() {
 }
 
 inline bool GFlow::wouldOverlap(vect<> pos, double R) {
-  for (auto P : particles) {
-    if (P) {
-      vect<> displacement = P->getPosition()-pos;
-      double minSepSqr = sqr(R + P->getRadius());
-      if (displacement*displacement < minSepSqr) return true;
-    }
+  if (overlapDirty) {
+    // Cells about one particle diameter wide
+    double maxR = R;
+    for (auto P : particles) maxR = max(maxR, P->getRadius());
+    overlapGrid.setBounds(left, right, bottom, top, 2*maxR, max(1024, 4*static_cast<int>(particles.size())));
+    for (size_t i=0; i<particles.size(); i++) overlapGrid.insert(i, particles[i]->getPosition(), particles[i]->getRadius());
+    overlapDirty = false;
   }
-  return false;
+  return overlapGrid.search(pos, R, [&] (int i) {
+      Particle *P = particles[i];
+      if (P==0) return false;
+      vect<> displacement = P->getPosition()-pos;
+      return displacement*displacement < sqr(R + P->getRadius());
+    });
 }
 
 inline void GFlow::updateSectors() {
-  for (int i=0; i<(secX+2)*(secY+2)+1; i++) {
-    vector<list<Particle*>::iterator> remove;
-    for (auto p=sectors[i].begin(); p!=sectors[i].end(); ++p) {
-      int sec = getSec((*p)->getPosition());
-      if (sec != i) { // In the wrong sector
-        remove.push_back(p);
-        sectors[sec].push_back(*p);
-      }
-    }
-    // Remove particles that moved
-    for (auto P : remove) sectors[i].erase(P);
-  }
+  // Counting sort the particles into sectors
+  cellOf.resize(particles.size());
+  for (size_t i=0; i<particles.size(); i++) cellOf[i] = getSec(particles[i]->getPosition());
+  sectors.build(cellOf);
 }
 
 inline void GFlow::ppInteract() {
   for (int y=1; y<secY+1; y++)
     for (int x=1; x<secX+1; x++)
       // Check in surrounding sectors
-      for (auto P : sectors[y*(secX+2)+x])
+      for (int k=sectors.begin(y*(secX+2)+x); k<sectors.end(y*(secX+2)+x); k++) {
+        Particle *P = particles[sectors.at(k)];
         for (int j=y-1; j<=y+1; j++)
           for (int i=x-1; i<=x+1; i++)
-            for (auto Q : sectors[j*(secX+2)+i])
+            for (int l=sectors.begin(j*(secX+2)+i); l<sectors.end(j*(secX+2)+i); l++) {
+              Particle *Q = particles[sectors.at(l)];
               if (P && P!=Q) P->interact(Q);
+            }
+      }
   // Have to try to interact everything in the special sector with everything else
   if (ssecInteract) {
-    for (auto P : sectors[(secX+2)*(secY+2)])
+    int ssec = (secX+2)*(secY+2);
+    for (int k=sectors.begin(ssec); k<sectors.end(ssec); k++) {
+      Particle *P = particles[sectors.at(k)];
       for (auto Q : particles)
         if (P && P!=Q) P->interact(Q);
+    }
   }
 }
 
@@ -3,12 +3,12 @@
 
 #include "MAC.h"
 #include "Object.h"
+#include "CellList.h"
 
 #include <list>
 using std::list;
 
 enum BType { WRAP, RANDOM, NONE };
-enum PType { PASSIVE, RTSPHERE };
 
 class GFlow : public MAC {
  public:
@@ -80,7 +80,10 @@ class GFlow : public MAC {
   inline void updateSectors();
   inline void ppInteract();
   inline int getSec(vect<>);
-  list<Particle*>* sectors;
+  CellList sectors; // Indices into particles, sorted by sector
+  vector<int> cellOf; // The sector of each particle, while sorting
+  OverlapGrid overlapGrid; // Grid of the particles, for wouldOverlap
+  bool overlapDirty; // Whether the particles have moved since the grid was built
   int secX, secY; // Width and height of sector grid
   bool sectorize; // Whether to use sector based interactions
   bool ssecInteract; // Whether objects in the special sector should interact with other objects
@@ -0,0 +1,117 @@
+#include "Integrator.h"
+
+/// Gear corrector coefficients for 5 values (position through the second derivative of the
+/// acceleration). The first is 19/90 rather than 19/120 because the forces depend on the velocity
+const double gear_coeff[5] = {19./90., 3./4., 1., 1./2., 1./12.};
+
+/// Without contacts the corrector makes the higher derivatives decay geometrically, until they are
+/// subnormal and every operation on them is very slow. Values this small don't matter, so drop them
+inline void flush(double& x) { if (fabs(x)<1e-150) x = 0; }
+inline void flush(vect<>& v) { flush(v.x); flush(v.y); }
+
+void Integrator::step(Particle* P, double epsilon) const {
+  switch (type) {
+  default:
+  case EULER: euler(P, epsilon); break;
+  case VELOCITY_VERLET: verlet(P, epsilon); break;
+  case GEAR: gear(P, epsilon); break;
+  case BAOAB: baoab(P, epsilon); break;
+  }
+  P->step = epsilon;
+}
+
+inline void Integrator::euler(Particle* P, double epsilon) const {
+  P->acceleration = P->invMass*(P->normalF + P->shearF + P->force);
+  P->position += epsilon*(P->velocity + 0.5*epsilon*P->acceleration);
+  P->velocity += epsilon*P->acceleration;
+  P->alpha = P->invII*P->torque;
+  P->theta += epsilon*(P->omega + 0.5*epsilon*P->alpha);
+  P->omega += epsilon*P->alpha;
+}
+
+inline void Integrator::verlet(Particle* P, double epsilon) const {
+  vect<> acc = P->invMass*(P->normalF + P->shearF + P->force);
+  double alp = P->invII*P->torque;
+  // The velocity was predicted with the last acceleration over the whole of the last step, the second
+  // half of that step should have used this one
+  double h = 0.5*P->step;
+  P->velocity += h*(acc - P->acceleration);
+  P->omega += h*(alp - P->alpha);
+  // Then the same update as the first order scheme, which predicts the next velocity
+  P->acceleration = acc;
+  P->alpha = alp;
+  P->position += epsilon*(P->velocity + 0.5*epsilon*acc);
+  P->velocity += epsilon*acc;
+  P->theta += epsilon*(P->omega + 0.5*epsilon*alp);
+  P->omega += epsilon*alp;
+}
+
+inline void Integrator::gear(Particle* P, double epsilon) const {
+  vect<> acc = P->invMass*(P->normalF + P->shearF + P->force);
+  double alp = P->invII*P->torque;
+  double h = P->step;
+  // Correct the predicted values with the difference between the actual and predicted acceleration
+  if (h>0) {
+    vect<> D = 0.5*sqr(h)*(acc - P->acceleration);
+    double d = 0.5*sqr(h)*(alp - P->alpha);
+    double h1 = 1./h, h3 = 6.*h1*h1*h1, h4 = 24.*sqr(sqr(h1));
+    P->position += gear_coeff[0]*D;
+    P->velocity += gear_coeff[1]*h1*D;
+    P->jerk += gear_coeff[3]*h3*D;
+    P->snap += gear_coeff[4]*h4*D;
+    P->theta += gear_coeff[0]*d;
+    P->omega += gear_coeff[1]*h1*d;
+    P->angJerk += gear_coeff[3]*h3*d;
+    P->angSnap += gear_coeff[4]*h4*d;
+  }
+  else { // Nothing to correct, start the higher derivatives at zero
+    P->jerk = P->snap = Zero;
+    P->angJerk = P->angSnap = 0;
+  }
+  P->acceleration = acc;
+  P->alpha = alp;
+  // Predict the values at the end of the step (Taylor series)
+  double e2 = sqr(epsilon)/2., e3 = e2*epsilon/3., e4 = e3*epsilon/4.;
+  P->position += epsilon*P->velocity + e2*P->acceleration + e3*P->jerk + e4*P->snap;
+  P->velocity += epsilon*P->acceleration + e2*P->jerk + e3*P->snap;
+  P->acceleration += epsilon*P->jerk + e2*P->snap;
+  P->jerk += epsilon*P->snap;
+  flush(P->jerk); flush(P->snap);
+  P->theta += epsilon*P->omega + e2*P->alpha + e3*P->angJerk + e4*P->angSnap;
+  P->omega += epsilon*P->alpha + e2*P->angJerk + e3*P->angSnap;
+  P->alpha += epsilon*P->angJerk + e2*P->angSnap;
+  P->angJerk += epsilon*P->angSnap;
+  flush(P->angJerk); flush(P->angSnap);
+}
+
+inline void Integrator::baoab(Particle* P, double epsilon) const {
+  vect<> acc = P->invMass*(P->normalF + P->shearF + P->force);
+  double alp = P->invII*P->torque;
+  // B (end of the last step): as in verlet, the velocity was predicted with the last acceleration
+  double h = 0.5*P->step;
+  P->velocity += h*(acc - P->acceleration);
+  P->omega += h*(alp - P->alpha);
+  P->acceleration = acc;
+  P->alpha = alp;
+  h = 0.5*epsilon;
+  // B
+  P->velocity += h*acc;
+  P->omega += h*alp;
+  // A
+  P->position += h*P->velocity;
+  P->theta += h*P->omega;
+  // O, an exact step of the Ornstein-Uhlenbeck process
+  if (temperature>0) {
+    double c1 = exp(-friction*epsilon), c2 = sqrt((1-sqr(c1))*temperature);
+    RandomStream& random = P->random;
+    double nx = randNormal(random), ny = randNormal(random);
+    P->velocity = c1*P->velocity + c2*sqrt(P->invMass)*vect<>(nx, ny);
+    P->omega = c1*P->omega + c2*sqrt(P->invII)*randNormal(random);
+  }
+  // A
+  P->position += h*P->velocity;
+  P->theta += h*P->omega;
+  // B, predicted with this step's acceleration
+  P->velocity += h*acc;
+  P->omega += h*alp;
+}
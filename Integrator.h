@@ -0,0 +1,50 @@
+/// Header for Integrator.h
+/// Schemes for moving a particle over a time step, given the forces found at its current state.
+///
+/// The forces are found once per step, before the particles are moved, and most of them depend on the
+/// velocity (dissipation, friction, drag). So every scheme leaves the particle with a predicted
+/// velocity for the next step's forces, and corrects it once those forces are known. Each particle
+/// keeps the length of its last step, so the correction is right when steps change or are substepped.
+
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "Object.h"
+
+/// EULER is the original scheme, x += eps(v + eps a/2), v += eps a, which is first order in the velocity.
+/// VELOCITY_VERLET is second order. GEAR is a 5-value Gear predictor-corrector, which is accurate for
+/// smooth forces but needs steps well below m/c for a dissipation c (it is unstable in the dense pipes
+/// at 1e-4). BAOAB is a Langevin splitting that holds the particles at a temperature (without one, it
+/// is the same as VELOCITY_VERLET).
+enum IntegratorType { EULER, VELOCITY_VERLET, GEAR, BAOAB };
+
+const double default_langevin_friction = 1.0;
+
+class Integrator {
+ public:
+  Integrator(IntegratorType type=EULER) : type(type), temperature(0), friction(default_langevin_friction) {};
+
+  void step(Particle*, double) const; // Move the particle with the forces acting on it
+
+  // Accessors
+  IntegratorType getType() const { return type; }
+  double getTemperature() const { return temperature; }
+  double getFriction() const { return friction; }
+
+  // Mutators
+  void setType(IntegratorType t) { type = t; }
+  void setTemperature(double T) { temperature = T; } // kT of the Langevin bath
+  void setFriction(double g) { friction = g; } // Langevin friction rate (1/time)
+
+ private:
+  inline void euler(Particle*, double) const;
+  inline void verlet(Particle*, double) const;
+  inline void gear(Particle*, double) const;
+  inline void baoab(Particle*, double) const;
+
+  IntegratorType type;
+  double temperature;
+  double friction;
+};
+
+#endif
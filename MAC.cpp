@@ -6,6 +6,16 @@ MAC::MAC(int width, int height) : nx(width), ny(height), time(0), iter(0), dispD
   _U_bdd = _V_bdd = 0;
 
   stickBC = true;
+  fastKernels = true;
+  kernelsDirty = true;
+  pressureSolver = SOR_PRESSURE;
+  preconditioner = MULTIGRID_PRECONDITIONER;
+  pressureIters = 0;
+  pressureResidual = 0;
+  pressureDirty = true;
+  pcgTolerance = 1e-6;
+  multigrid.setTolerance(pcgTolerance);
+  multigrid.setAccelerate(false); // Only MULTIGRID_PRESSURE calls solve, and it means plain cycles
   wrapX = false;
   wrapY = false;
   left = bottom = 0.;
@@ -337,6 +347,8 @@ void MAC::lockP(int x, int y, double p) {
   //** CHECK
   P(x,y) = p;
   P_bdd(x,y) = true;
+  pressureDirty = true;
+  kernelsDirty = true;
 }
 
 void MAC::createWallBC(vect<> start, vect<> end) {
@@ -491,11 +503,14 @@ inline void MAC::setDistances() {
 inline void MAC::setSOR() {
   // There is also a lower bound on the number of solveIters we need
   solveIters = 2*max(nx,ny);
+  pcgMaxIters = 10*max(nx,ny);
   tollerance = 1e-8;
   beta = 2.0/(1+2*PI/(nx+ny));
 }
 
 inline void MAC::setCoeffs() {
+  pressureDirty = true;
+  kernelsDirty = true;
   for (int i=0; i<nx+2; i++) C(i,0) = C(i,ny+1) = 0;
   for (int i=0; i<ny+2; i++) C(0,i) = C(nx+1,i) = 0;
   for (int y=1; y<ny+1; y++)
@@ -510,6 +525,10 @@ inline void MAC::setCoeffs() {
 }
 
 inline void MAC::velocities(double epsilon) {
+  if (fastKernels) {
+    fastVelocities(epsilon);
+    return;
+  }
   for (int i=1; i<nx; i++)
     for (int j=1; j<ny+1; j++) {// temporary u-velocity
       if (!U_bdd(i,j).bc) {
@@ -709,6 +728,10 @@ void MAC::resetEpsilon() {
 }
 
 inline void MAC::correct(double epsilon) {
+  if (fastKernels) {
+    fastCorrect(epsilon);
+    return;
+  }
   for (int i=1; i<nx; i++)
     for (int j=1; j<ny+1; j++)
       //if (!P_bdd(i+1,j) && P_bdd(i,j))
@@ -832,6 +855,10 @@ inline void MAC::initialize() {
 }
 
 inline void MAC::boundary() {
+  if (fastKernels) {
+    fastBoundary();
+    return;
+  }
   if (stickBC) {
     for (int i=0; i<nx+1; i++) {
       U(i,0) = 2*us-U(i,1);
@@ -885,6 +912,10 @@ inline void MAC::boundary() {
 }
 
 inline void MAC::velocityBoundary() {
+  if (fastKernels) {
+    fastVelocityBoundary();
+    return;
+  }
   // Ut
   for (int y=1; y<ny+1; y++)
     for (int x=1; x<nx; x++) {
@@ -917,6 +948,10 @@ inline void MAC::velocityBoundary() {
 }
 
 inline void MAC::bodyForces(double epsilon) {
+  if (fastKernels) {
+    fastBodyForces(epsilon);
+    return;
+  }
   double mt = epsilon*rhoS*hx*hy;
   // Apply gravity
   for (int y=1; y<ny+1; y++)
@@ -928,6 +963,18 @@ inline void MAC::bodyForces(double epsilon) {
 }
 
 inline void MAC::computePressure(double epsilon) {
+  if (pressureSolver==MULTIGRID_PRESSURE) {
+    multigridPressure(epsilon);
+    return;
+  }
+  if (pressureSolver==PCG_PRESSURE) {
+    pcgPressure(epsilon);
+    return;
+  }
+  if (fastKernels) {
+    redBlackPressure(epsilon);
+    return;
+  }
   // Solve the pressure poisson equation using Successive Over-Relaxation
   double maxDSqr=1.;
   int it;
@@ -935,18 +982,403 @@ inline void MAC::computePressure(double epsilon) {
     maxDSqr = 0;
     for (int i=1; i<nx+1; i++)
       for (int j=1; j<ny+1; j++) { 
-	if ((i+j)%2==0 && !P_bdd(i,j)) 
+	if ((i+j)%2==0 && pressureCell(i+(nx+2)*j)) 
 	  SOR_site(i,j,maxDSqr);
       }
     for (int i=1; i<nx+1; i++)
       for (int j=1; j<ny+1; j++) {
-        if ((i+j)%2!=0 && !P_bdd(i,j))
+        if ((i+j)%2!=0 && pressureCell(i+(nx+2)*j))
           SOR_site(i,j,maxDSqr);
       }
   }
+  pressureIters = it;
+}
+
+inline void MAC::setKernelMasks() {
+  uOpen.resize((nx+1)*(ny+2));
+  for (int k=0; k<(nx+1)*(ny+2); k++) uOpen[k] = !_U_bdd[k].bc;
+  vOpen.resize((nx+2)*(ny+1));
+  for (int k=0; k<(nx+2)*(ny+1); k++) vOpen[k] = !_V_bdd[k].bc;
+  rbWidth = (nx+3)/2;
+  for (int c=0; c<2; c++) {
+    rbP[c].assign(rbWidth*(ny+2), 0);
+    rbC[c].assign(rbWidth*(ny+2), 0);
+    rbF[c].assign(rbWidth*(ny+2), 0);
+    rbOpen[c].assign(rbWidth*(ny+2), 0);
+    for (int y=0; y<ny+2; y++)
+      for (int x=(y+c)%2, h=0; x<nx+2; x+=2, h++) {
+        rbC[c][h+rbWidth*y] = _C[x+(nx+2)*y];
+        rbOpen[c][h+rbWidth*y] = 0<x && x<nx+1 && 0<y && y<ny+1 && pressureCell(x+(nx+2)*y);
+      }
+  }
+  kernelsDirty = false;
+}
+
+inline void MAC::fastBoundary() {
+  if (kernelsDirty) setKernelMasks();
+  int su = nx+1, sv = nx+2;
+  double *U0 = _U, *U1 = _U+su, *Un = _U+su*ny, *Un1 = _U+su*(ny+1);
+  if (stickBC) {
+    for (int i=0; i<nx+1; i++) {
+      U0[i] = 2*us-U1[i];
+      Un1[i] = 2*un-Un[i];
+    }
+    for (int j=0; j<ny+1; j++) {
+      _V[sv*j] = 2*vw-_V[1+sv*j];
+      _V[nx+1+sv*j] = 2*ve-_V[nx+sv*j];
+    }
+  }
+  else {
+    for (int i=0; i<nx+1; i++) {
+      U0[i] = us!=0 ? 2*us-U1[i] : U1[i];
+      Un1[i] = un!=0 ? 2*un-Un[i] : Un[i];
+    }
+    for (int j=0; j<ny+1; j++) {
+      _V[sv*j] = vw!=0 ? 2*vw-_V[1+sv*j] : _V[1+sv*j];
+      _V[nx+1+sv*j] = ve!=0 ? 2*ve-_V[nx+sv*j] : _V[nx+sv*j];
+    }
+  }
+  for (int y=1; y<ny+1; y++) {
+    double *u = _U+su*y;
+    const char *open = &uOpen[su*y];
+#pragma omp simd
+    for (int x=1; x<nx; x++) u[x] = open[x] ? u[x] : 0;
+  }
+  for (int y=1; y<ny; y++) {
+    double *v = _V+sv*y;
+    const char *open = &vOpen[sv*y];
+#pragma omp simd
+    for (int x=1; x<nx+1; x++) v[x] = open[x] ? v[x] : 0;
+  }
+}
+
+inline void MAC::fastVelocityBoundary() {
+  if (kernelsDirty) setKernelMasks();
+  int su = nx+1, sv = nx+2;
+  for (int y=1; y<ny+1; y++) {
+    double *ut = _Ut+su*y;
+    const char *open = &uOpen[su*y];
+#pragma omp simd
+    for (int x=1; x<nx; x++) ut[x] = open[x] ? ut[x] : 0;
+  }
+  for (int y=1; y<ny; y++) {
+    double *vt = _Vt+sv*y;
+    const char *open = &vOpen[sv*y];
+#pragma omp simd
+    for (int x=1; x<nx+1; x++) vt[x] = open[x] ? vt[x] : 0;
+  }
+}
+
+inline void MAC::fastVelocities(double epsilon) {
+  // Same arithmetic as velocities, one row at a time
+  if (kernelsDirty) setKernelMasks();
+  int su = nx+1, sv = nx+2;
+  double ax = 0.25/hx, ay = 0.25/hy, dx = nu/sqr(hx), dy = nu/sqr(hy);
+  for (int j=1; j<ny+1; j++) { // temporary u-velocity
+    const double *u = _U+su*j, *uN = u+su, *uS = u-su, *v = _V+sv*j, *vS = v-sv;
+    double *ut = _Ut+su*j;
+    const char *open = &uOpen[su*j];
+#pragma omp simd
+    for (int i=1; i<nx; i++) {
+      double t1 = sqr(u[i+1]+u[i])-sqr(u[i]+u[i-1]);
+      double t2 = (uN[i]+u[i])*(v[i+1]+v[i]);
+      double t3 = (u[i]+uS[i])*(vS[i+1]+vS[i]);
+      double t4 = -ax*(t1+t2-t3);
+      double t5 = u[i+1]+u[i-1]+uN[i]+uS[i]-4*u[i];
+      double t7 = u[i] + epsilon*(t4+dx*t5);
+      ut[i] = open[i] ? t7 : ut[i];
+    }
+  }
+  for (int j=1; j<ny; j++) { // temporary v-velocity
+    const double *v = _V+sv*j, *vN = v+sv, *vS = v-sv, *u = _U+su*j, *uN = u+su;
+    double *vt = _Vt+sv*j;
+    const char *open = &vOpen[sv*j];
+#pragma omp simd
+    for (int i=1; i<nx+1; i++) {
+      double t = v[i]+epsilon*(-ay*((uN[i]+u[i])*(v[i+1]+v[i])-(uN[i-1]+u[i-1])*(v[i]+v[i-1])+sqr(vN[i]+v[i])-sqr(v[i]+vS[i]))+dy*(v[i+1]+v[i-1]+vN[i]+vS[i]-4*v[i]));
+      vt[i] = open[i] ? t : vt[i];
+    }
+  }
+}
+
+inline void MAC::fastBodyForces(double epsilon) {
+  if (kernelsDirty) setKernelMasks();
+  int su = nx+1, sv = nx+2;
+  double mt = epsilon*rhoS*hx*hy, gx = mt*gravity.x, gy = mt*gravity.y;
+  for (int y=1; y<ny+1; y++) {
+    double *ut = _Ut+su*y;
+    const char *open = &uOpen[su*y];
+#pragma omp simd
+    for (int x=1; x<nx; x++) ut[x] = open[x] ? ut[x]+gx : ut[x];
+  }
+  for (int y=1; y<ny; y++) {
+    double *vt = _Vt+sv*y;
+    const char *open = &vOpen[sv*y];
+#pragma omp simd
+    for (int x=1; x<nx+1; x++) vt[x] = open[x] ? vt[x]+gy : vt[x];
+  }
+}
+
+inline void MAC::fastCorrect(double epsilon) {
+  int su = nx+1, sp = nx+2;
+  double cx = epsilon/hx, cy = epsilon/hy;
+  for (int j=1; j<ny+1; j++) {
+    double *u = _U+su*j;
+    const double *ut = _Ut+su*j, *p = _P+sp*j;
+#pragma omp simd
+    for (int i=1; i<nx; i++) u[i] = ut[i]-cx*(p[i+1]-p[i]);
+  }
+  for (int j=1; j<ny; j++) {
+    double *v = _V+sp*j;
+    const double *vt = _Vt+sp*j, *p = _P+sp*j, *pN = p+sp;
+#pragma omp simd
+    for (int i=1; i<nx+1; i++) v[i] = vt[i]-cy*(pN[i]-p[i]);
+  }
+}
+
+inline void MAC::redBlackPressure(double epsilon) {
+  // The SOR of computePressure, with each colour stored contiguously. A cell only sees cells of the
+  // other colour, so a half sweep has no dependencies and the order within it does not matter. For a
+  // cell of colour c at h in row y, with o = (y+c)%2, the other colour has its west and east
+  // neighbours at h+o-1 and h+o, and its south and north neighbours at h in rows y-1 and y+1
+  if (kernelsDirty) setKernelMasks();
+  int W = rbWidth, sp = nx+2, su = nx+1;
+  double scale = hx/epsilon;
+  for (int c=0; c<2; c++)
+    for (int y=0; y<ny+2; y++)
+      for (int x=(y+c)%2, h=0; x<nx+2; x+=2, h++) {
+        int k = x+sp*y;
+        rbP[c][h+W*y] = _P[k];
+        if (0<x && x<nx+1 && 0<y && y<ny+1)
+          rbF[c][h+W*y] = scale*(_Ut[x+su*y]-_Ut[x-1+su*y]+_Vt[k]-_Vt[k-sp]);
+      }
+  double maxDSqr = 1.;
+  double keep = 1-beta;
+  int it;
+  for (it=0; it<solveIters && tollerance<maxDSqr; it++) {
+    maxDSqr = 0;
+    for (int c=0; c<2; c++)
+      for (int y=1; y<ny+1; y++) {
+        int o = (y+c)%2;
+        double *p = &rbP[c][W*y];
+        const double *q = &rbP[1-c][W*y], *qN = q+W, *qS = q-W;
+        const double *C = &rbC[c][W*y], *F = &rbF[c][W*y];
+        const char *open = &rbOpen[c][W*y];
+        int end = (nx-o)/2;
+#pragma omp simd reduction(max:maxDSqr)
+        for (int h=1-o; h<=end; h++) {
+          double prs = q[h+o]+q[h+o-1]+qN[h]+qS[h];
+          double value = beta*C[h]*(prs - F[h]) + keep*p[h];
+          value = open[h] ? value : p[h];
+          double dSqr = sqr(value-p[h]);
+          maxDSqr = dSqr>maxDSqr ? dSqr : maxDSqr;
+          p[h] = value;
+        }
+      }
+  }
+  pressureIters = it;
+  for (int c=0; c<2; c++)
+    for (int y=1; y<ny+1; y++)
+      for (int x=(y+c)%2, h=0; x<nx+2; x+=2, h++)
+        _P[x+sp*y] = rbP[c][h+W*y];
+}
+
+inline void MAC::multigridPressure(double epsilon) {
+  // Pressure boundary cells are left out of the solve, and only enter through their values, as in SOR_site
+  if (pressureDirty) setupPressure();
+  for (int y=1; y<ny+1; y++)
+    for (int x=1; x<nx+1; x++) {
+      int i = (x-1)+nx*(y-1);
+      double bdd = 0;
+      if (P_bdd(x+1,y)) bdd += P(x+1,y);
+      if (P_bdd(x-1,y)) bdd += P(x-1,y);
+      if (P_bdd(x,y+1)) bdd += P(x,y+1);
+      if (P_bdd(x,y-1)) bdd += P(x,y-1);
+      mgP[i] = P(x,y);
+      mgF[i] = (hx/epsilon)*(Ut(x,y)-Ut(x-1,y)+Vt(x,y)-Vt(x,y-1)) - bdd;
+    }
+  pressureIters = multigrid.solve(&mgP[0], &mgF[0]);
+  pressureResidual = multigrid.getResidual();
+  for (int y=1; y<ny+1; y++)
+    for (int x=1; x<nx+1; x++)
+      if (pressureCell(x+(nx+2)*y)) P(x,y) = mgP[(x-1)+nx*(y-1)];
+}
+
+inline void MAC::pcgPressure(double epsilon) {
+  // Solves count*P - (sum of the fluid neighbours) = (sum of the boundary neighbours) - divergence, the
+  // equation SOR_site relaxes. Every boundary cell insulates, so the operator is singular, with one
+  // constant null vector per connected fluid region. Projecting the right hand side off of them makes the
+  // system consistent, and then conjugate gradient converges without projecting each iterate
+  if (pressureDirty) setupPressure();
+  int sx = nx+2, N = sx*(ny+2);
+  for (int k=0; k<N; k++) pcgX[k] = pcgB[k] = 0;
+  for (int y=1; y<ny+1; y++)
+    for (int x=1; x<nx+1; x++) {
+      int k = x+sx*y;
+      if (pcgDiag[k]==0) continue;
+      double bdd = 0;
+      if (_P_bdd[k+1]) bdd += _P[k+1];
+      if (_P_bdd[k-1]) bdd += _P[k-1];
+      if (_P_bdd[k+sx]) bdd += _P[k+sx];
+      if (_P_bdd[k-sx]) bdd += _P[k-sx];
+      pcgX[k] = _P[k]; // Warm start from the last step
+      pcgB[k] = bdd - (hx/epsilon)*(Ut(x,y)-Ut(x-1,y)+Vt(x,y)-Vt(x,y-1));
+    }
+  projectPressure(pcgB);
+  double bNorm = sqrt(dot(pcgB, pcgB));
+  if (bNorm==0) bNorm = 1; // The tolerance becomes absolute
+
+  applyPressure(pcgX, pcgQ);
+  for (int k=0; k<N; k++) pcgR[k] = pcgB[k]-pcgQ[k];
+  pressureResidual = sqrt(dot(pcgR, pcgR))/bNorm;
+  int it = 0;
+  if (pcgTolerance<pressureResidual) {
+    preconditionPressure(pcgR, pcgZ);
+    pcgD = pcgZ;
+    double rz = dot(pcgR, pcgZ);
+    while (it<pcgMaxIters) {
+      applyPressure(pcgD, pcgQ);
+      double dq = dot(pcgD, pcgQ);
+      if (dq<=0) break;
+      double alpha = rz/dq;
+      for (int k=0; k<N; k++) {
+        pcgX[k] += alpha*pcgD[k];
+        pcgR[k] -= alpha*pcgQ[k];
+      }
+      it++;
+      pressureResidual = sqrt(dot(pcgR, pcgR))/bNorm;
+      if (pressureResidual<=pcgTolerance) break;
+      preconditionPressure(pcgR, pcgZ);
+      double rzNew = dot(pcgR, pcgZ), beta = rzNew/rz;
+      rz = rzNew;
+      for (int k=0; k<N; k++) pcgD[k] = pcgZ[k]+beta*pcgD[k];
+    }
+  }
+  pressureIters = it;
+  for (int k=0; k<N; k++)
+    if (pcgDiag[k]!=0) _P[k] = pcgX[k];
+}
+
+inline void MAC::setupPressure() {
+  int sx = nx+2, N = sx*(ny+2);
+  // Operator diagonal, zero off the cells the solvers update
+  pcgDiag.assign(N, 0);
+  for (int y=1; y<ny+1; y++)
+    for (int x=1; x<nx+1; x++) {
+      int k = x+sx*y;
+      if (!pressureCell(k)) continue;
+      pcgDiag[k] = !_P_bdd[k+1] + !_P_bdd[k-1] + !_P_bdd[k+sx] + !_P_bdd[k-sx];
+    }
+  // Label the connected fluid regions, since a wall can cut one off
+  pcgComponent.assign(N, -1);
+  pcgComponentSize.clear();
+  vector<int> stack;
+  for (int k=0; k<N; k++) {
+    if (pcgDiag[k]==0 || pcgComponent[k]!=-1) continue;
+    int c = pcgComponentSize.size(), size = 0;
+    pcgComponent[k] = c;
+    stack.push_back(k);
+    while (!stack.empty()) {
+      int j = stack.back();
+      stack.pop_back();
+      size++;
+      for (int n : {j+1, j-1, j+sx, j-sx})
+        if (pcgDiag[n]!=0 && pcgComponent[n]==-1) {
+          pcgComponent[n] = c;
+          stack.push_back(n);
+        }
+    }
+    pcgComponentSize.push_back(size);
+  }
+  // Modified incomplete Cholesky, MIC(0): the fill that IC(0) drops is mostly put back on the diagonal
+  // (tau), which keeps the row sums of the factorization equal to those of the operator. Where that
+  // would leave a small pivot (the last cell of each region, since the operator is singular), the
+  // pivot falls back to the diagonal (sigma)
+  const double tau = 0.97, sigma = 0.25;
+  pcgPrecon.assign(N, 0);
+  for (int y=1; y<ny+1; y++)
+    for (int x=1; x<nx+1; x++) {
+      int k = x+sx*y;
+      if (pcgDiag[k]==0) continue;
+      double e = pcgDiag[k], pw = pcgPrecon[k-1], ps = pcgPrecon[k-sx];
+      e -= sqr(pw) + sqr(ps);
+      e -= tau*(sqr(pw)*(pcgDiag[k-1+sx]!=0) + sqr(ps)*(pcgDiag[k-sx+1]!=0));
+      if (e<sigma*pcgDiag[k]) e = pcgDiag[k];
+      pcgPrecon[k] = 1./sqrt(e);
+    }
+  pcgX = pcgB = pcgR = pcgZ = pcgD = pcgQ = vector<double>(N, 0);
+  // Multigrid, for the multigrid solver or preconditioner
+  if (pressureSolver==MULTIGRID_PRESSURE || (pressureSolver==PCG_PRESSURE && preconditioner==MULTIGRID_PRECONDITIONER)) {
+    vector<char> mask(nx*ny);
+    for (int y=1; y<ny+1; y++)
+      for (int x=1; x<nx+1; x++)
+        mask[(x-1)+nx*(y-1)] = pressureCell(x+sx*y) ? MG_FREE : MG_EXCLUDED;
+    multigrid.setup(nx, ny, 1, 1, mask);
+    mgP.resize(nx*ny);
+    mgF.resize(nx*ny);
+  }
+  pressureDirty = false;
 }
 
+inline void MAC::applyPressure(const vector<double>& d, vector<double>& q) {
+  // Vectors are zero off the fluid cells, so every fluid cell can add up all four neighbours
+  int sx = nx+2;
+  for (int y=1; y<ny+1; y++)
+    for (int x=1; x<nx+1; x++) {
+      int k = x+sx*y;
+      q[k] = pcgDiag[k]!=0 ? pcgDiag[k]*d[k] - (d[k+1]+d[k-1]+d[k+sx]+d[k-sx]) : 0;
+    }
+}
 
+inline void MAC::preconditionPressure(const vector<double>& r, vector<double>& z) {
+  int sx = nx+2;
+  if (preconditioner==JACOBI_PRECONDITIONER) {
+    for (int k=0; k<(int)r.size(); k++) z[k] = pcgDiag[k]!=0 ? r[k]/pcgDiag[k] : 0;
+  }
+  else if (preconditioner==INCOMPLETE_CHOLESKY_PRECONDITIONER) {
+    // Solve L q = r, then L^T z = q, with L = (strict lower part of A) E + E^-1, E = pcgPrecon
+    for (int y=1; y<ny+1; y++)
+      for (int x=1; x<nx+1; x++) {
+        int k = x+sx*y;
+        z[k] = pcgDiag[k]!=0 ? (r[k] + pcgPrecon[k-1]*z[k-1] + pcgPrecon[k-sx]*z[k-sx])*pcgPrecon[k] : 0;
+      }
+    for (int y=ny; y>0; y--)
+      for (int x=nx; x>0; x--) {
+        int k = x+sx*y;
+        z[k] = pcgDiag[k]!=0 ? (z[k] + pcgPrecon[k]*(z[k+1]+z[k+sx]))*pcgPrecon[k] : 0;
+      }
+  }
+  else {
+    for (int y=1; y<ny+1; y++)
+      for (int x=1; x<nx+1; x++) mgF[(x-1)+nx*(y-1)] = r[x+sx*y];
+    multigrid.precondition(&mgF[0], &mgP[0]);
+    for (int y=1; y<ny+1; y++)
+      for (int x=1; x<nx+1; x++) {
+        int k = x+sx*y;
+        z[k] = pcgDiag[k]!=0 ? mgP[(x-1)+nx*(y-1)] : 0;
+      }
+  }
+}
+
+inline void MAC::projectPressure(vector<double>& v) {
+  vector<double> sum(pcgComponentSize.size(), 0);
+  for (int k=0; k<(int)v.size(); k++)
+    if (pcgComponent[k]!=-1) sum[pcgComponent[k]] += v[k];
+  for (int c=0; c<(int)sum.size(); c++) sum[c] /= pcgComponentSize[c];
+  for (int k=0; k<(int)v.size(); k++)
+    if (pcgComponent[k]!=-1) v[k] -= sum[pcgComponent[k]];
+}
+
+inline double MAC::dot(const vector<double>& a, const vector<double>& b) {
+  double sum = 0;
+  for (int k=0; k<(int)a.size(); k++) sum += a[k]*b[k];
+  return sum;
+}
+
+inline bool MAC::pressureCell(int k) {
+  int sx = nx+2;
+  return !_P_bdd[k] && (!_P_bdd[k+1] || !_P_bdd[k-1] || !_P_bdd[k+sx] || !_P_bdd[k-sx]);
+}
 
 inline void MAC::SOR_site(int x, int y, double& maxDSqr) {
   double prs = P(x+1,y)+P(x-1,y)+P(x,y+1)+P(x,y-1);
@@ -6,6 +6,7 @@
 #define MAC_H
 
 #include "Utility.h"
+#include "Multigrid.h"
 
 struct Bdd {
   Bdd() : left(false), bc(false) {};
@@ -16,6 +17,15 @@ struct Bdd {
   bool x; // x1/hx
 };
 
+/// How the pressure equation is solved. MULTIGRID_PRESSURE runs plain multigrid cycles; conjugate
+/// gradient preconditioned by the same cycles is PCG_PRESSURE with MULTIGRID_PRECONDITIONER
+enum PressureSolver { SOR_PRESSURE, MULTIGRID_PRESSURE, PCG_PRESSURE };
+
+/// Preconditioner for the conjugate gradient pressure solver. Multigrid, the default, takes a
+/// handful of iterations at any size. Jacobi and incomplete Cholesky need more iterations on larger
+/// grids, and in the poisson benchmark they are slower per step than SOR
+enum Preconditioner { JACOBI_PRECONDITIONER, INCOMPLETE_CHOLESKY_PRECONDITIONER, MULTIGRID_PRECONDITIONER };
+
 /// The Marker and Cell fluid simulator class
 class MAC {
  public:
@@ -56,6 +66,8 @@ class MAC {
   int getIter() { return iter; }
   double getRealTime() { return realTime; }
   double getEpsilon() { return epsilon; }
+  int getPressureIters() { return pressureIters; } // Iterations (or cycles) of the last pressure solve
+  double getPressureResidual() { return pressureResidual; } // Relative residual of the last multigrid or PCG solve
 
   // Mutators
   void setBounds(double,double,double,double);
@@ -71,6 +83,11 @@ class MAC {
   void setUS(double u) { us = u; }
   void setVE(double v) { ve = v; }
   void setVW(double v) { vw = v; }
+  void setPressureSolver(PressureSolver s) { pressureSolver = s; pressureDirty = true; }
+  void setPreconditioner(Preconditioner p) { preconditioner = p; pressureDirty = true; } // Multigrid by default; Jacobi and MIC are slower than SOR
+  void setPressureTolerance(double t) { pcgTolerance = t; multigrid.setTolerance(t); }
+  void setCycleType(CycleType c) { multigrid.setCycleType(c); }
+  void setFastKernels(bool f) { fastKernels = f; } // False runs the bounds checked versions, for debugging
   void lockP(int,int,double);
   void createWallBC(vect<>, vect<>);
 
@@ -135,6 +152,34 @@ class MAC {
   // Updated a site using SOR
   inline void SOR_site(int, int, double&);
 
+  // Whether the pressure solvers update cell k: a fluid cell with at least one fluid neighbour. A cell
+  // walled in on all four sides has no equation, so it keeps its pressure, like a boundary cell
+  inline bool pressureCell(int k);
+
+  // Bounds check free versions of the above, on the raw arrays, vectorized along rows
+  inline void setKernelMasks();
+  inline void fastBoundary();
+  inline void fastVelocityBoundary();
+  inline void fastVelocities(double);
+  inline void fastBodyForces(double);
+  inline void fastCorrect(double);
+  inline void redBlackPressure(double);
+
+  // Solve for the pressure with multigrid
+  inline void multigridPressure(double);
+
+  // Solve for the pressure with preconditioned conjugate gradient
+  inline void pcgPressure(double);
+
+  // Rebuild what the multigrid and PCG solvers know about the pressure boundary cells
+  inline void setupPressure();
+
+  // Matrix free pressure operator and preconditioner, on arrays laid out like _P
+  inline void applyPressure(const vector<double>&, vector<double>&);
+  inline void preconditionPressure(const vector<double>&, vector<double>&);
+  inline void projectPressure(vector<double>&);
+  inline double dot(const vector<double>&, const vector<double>&);
+
   /// Printing
   string pressureRec;
   string velocityRec;
@@ -165,6 +210,32 @@ class MAC {
   double tollerance;
   double beta;
 
+  /// Fast kernels
+  bool fastKernels;
+  bool kernelsDirty; // Set when the boundary cells change
+  vector<char> uOpen, vOpen; // Whether each U (V) has no boundary condition on it
+  // The pressure grid split by colour, (x+y)%2, so that each SOR half sweep is contiguous. Colour c
+  // holds x = 2h+((y+c)%2) at h+rbWidth*y, ring included
+  int rbWidth;
+  vector<double> rbP[2], rbC[2], rbF[2];
+  vector<char> rbOpen[2];
+
+  /// Pressure solver
+  PressureSolver pressureSolver;
+  Preconditioner preconditioner;
+  int pressureIters;
+  double pressureResidual;
+  bool pressureDirty; // Set when P_bdd or the solver changes
+  Multigrid multigrid;
+  vector<double> mgP, mgF; // Pressure and source, on the fluid cells only
+  int pcgMaxIters;
+  double pcgTolerance; // Target for |residual|/|right hand side|
+  vector<double> pcgDiag;  // Number of fluid neighbours of each fluid cell, zero elsewhere
+  vector<int> pcgComponent; // Which connected fluid region each cell is in, -1 if none
+  vector<double> pcgComponentSize;
+  vector<double> pcgPrecon; // Inverse square root of the incomplete Cholesky diagonal
+  vector<double> pcgX, pcgB, pcgR, pcgZ, pcgD, pcgQ;
+
   /// Simulation Specs
   double epsilon;  // Time step
   double runTime;  // How long the simulation is supposed to run
@@ -0,0 +1,280 @@
+#include "Multigrid.h"
+
+Multigrid::Multigrid() : floating(0), wx(1), wy(1), wrapX(false), wrapY(false), cycleType(W_CYCLE), preSweeps(2), postSweeps(2), coarseSweeps(20), minSize(4), tolerance(1e-8), maxCycles(100), overcorrection(1.8), accelerate(true), cycles(0), residual(0) {};
+
+void Multigrid::setup(int nx, int ny, double wx, double wy, const vector<char>& mask, bool wrapX, bool wrapY) {
+  this->wx = wx; this->wy = wy;
+  this->wrapX = wrapX; this->wrapY = wrapY;
+  this->mask = mask;
+  levels.clear();
+  levels.push_back(Level());
+  Level& fine = levels[0];
+  int n = nx*ny;
+  fine.nx = nx; fine.ny = ny;
+  fine.east = fine.north = fine.diag = vector<double>(n, 0);
+  fine.x = fine.b = fine.r = vector<double>(n, 0);
+  fixed = vector<char>(n, 0);
+  vector<char> touches(n, 0); // Whether a free point has a fixed neighbour
+  auto type = [&] (int i) { return mask.empty() ? MG_FREE : mask[i]; };
+  // A neighbour adds to the diagonal unless it is excluded, and is linked if it is free
+  auto neighbour = [&] (int i, int j, double w, double* link) {
+    if (i==j || type(j)==MG_EXCLUDED) return;
+    fine.diag[i] += w;
+    if (type(j)==MG_FREE && link) *link = w;
+    if (type(j)==MG_FIXED) touches[i] = 1;
+  };
+  for (int y=0; y<ny; y++)
+    for (int x=0; x<nx; x++) {
+      int i = x+nx*y;
+      fixed[i] = type(i)==MG_FIXED;
+      if (type(i)!=MG_FREE) continue;
+      if (x<nx-1 || wrapX) neighbour(i, (x<nx-1 ? x+1 : 0)+nx*y, wx, &fine.east[i]);
+      if (0<x || wrapX) neighbour(i, (0<x ? x-1 : nx-1)+nx*y, wx, 0);
+      if (y<ny-1 || wrapY) neighbour(i, x+nx*(y<ny-1 ? y+1 : 0), wy, &fine.north[i]);
+      if (0<y || wrapY) neighbour(i, x+nx*(0<y ? y-1 : ny-1), wy, 0);
+    }
+  // Label the connected regions of free points. A wall can cut the grid into several, and each one
+  // that touches no fixed point is only defined up to its own constant
+  component.assign(n, -1);
+  componentSize.clear();
+  componentFloats.clear();
+  floating = 0;
+  vector<int> stack;
+  for (int k=0; k<n; k++) {
+    if (fine.diag[k]==0 || component[k]!=-1) continue;
+    int c = componentSize.size(), size = 0;
+    bool grounded = false;
+    component[k] = c;
+    stack.push_back(k);
+    while (!stack.empty()) {
+      int i = stack.back(), x = i%nx, y = i/nx;
+      stack.pop_back();
+      size++;
+      if (touches[i]) grounded = true;
+      int w = (0<x ? x-1 : nx-1)+nx*y, s = x+nx*(0<y ? y-1 : ny-1);
+      int e = (x<nx-1 ? x+1 : 0)+nx*y, nn = x+nx*(y<ny-1 ? y+1 : 0);
+      // Links are stored once, on the west (south) point of each pair
+      int linked[4] = {0<fine.east[i] ? e : -1, 0<fine.east[w] ? w : -1, 0<fine.north[i] ? nn : -1, 0<fine.north[s] ? s : -1};
+      for (int j : linked)
+        if (j!=-1 && component[j]==-1) {
+          component[j] = c;
+          stack.push_back(j);
+        }
+    }
+    componentSize.push_back(size);
+    componentFloats.push_back(!grounded);
+    if (!grounded) floating++;
+  }
+  // Build coarser levels until the grid is small enough to solve by relaxation
+  while (minSize<levels.back().nx || minSize<levels.back().ny) {
+    Level coarse;
+    coarsen(levels.back(), coarse);
+    levels.push_back(coarse);
+  }
+}
+
+int Multigrid::solve(double* p, const double* f) {
+  if (levels.empty()) return 0;
+  Level& L = levels[0];
+  int nx = L.nx, ny = L.ny;
+  // Move the fixed values to the right hand side
+  for (int y=0; y<ny; y++)
+    for (int x=0; x<nx; x++) {
+      int i = x+nx*y;
+      L.b[i] = L.x[i] = 0;
+      if (L.diag[i]==0) continue;
+      double b = -f[i];
+      int e = (x<nx-1 ? x+1 : 0)+nx*y, w = (0<x ? x-1 : nx-1)+nx*y;
+      int n = x+nx*(y<ny-1 ? y+1 : 0), s = x+nx*(0<y ? y-1 : ny-1);
+      if ((x<nx-1 || wrapX) && fixed[e]) b += wx*p[e];
+      if ((0<x || wrapX) && fixed[w]) b += wx*p[w];
+      if ((y<ny-1 || wrapY) && fixed[n]) b += wy*p[n];
+      if ((0<y || wrapY) && fixed[s]) b += wy*p[s];
+      L.b[i] = b;
+      L.x[i] = p[i];
+    }
+  project(L.b);
+  double bNorm = sqrt(dot(L.b, L.b));
+  if (bNorm==0) bNorm = 1; // The tolerance becomes absolute
+
+  cycles = 0;
+  if (accelerate) { // Conjugate gradient, preconditioned by one cycle
+    cgX = L.x;
+    apply(L, cgX, cgQ);
+    cgR.resize(cgX.size());
+    for (int i=0; i<nx*ny; i++) cgR[i] = L.b[i]-cgQ[i];
+    residual = sqrt(dot(cgR, cgR))/bNorm;
+    if (tolerance<residual) {
+      precondition(cgR, cgZ);
+      cgP = cgZ;
+      double rz = dot(cgR, cgZ);
+      while (tolerance<residual && cycles<maxCycles) {
+        apply(L, cgP, cgQ);
+        double pq = dot(cgP, cgQ);
+        if (pq<=0) break;
+        double alpha = rz/pq;
+        for (int i=0; i<nx*ny; i++) {
+          cgX[i] += alpha*cgP[i];
+          cgR[i] -= alpha*cgQ[i];
+        }
+        cycles++;
+        residual = sqrt(dot(cgR, cgR))/bNorm;
+        if (residual<=tolerance) break;
+        precondition(cgR, cgZ);
+        double rzNew = dot(cgR, cgZ), beta = rzNew/rz;
+        rz = rzNew;
+        for (int i=0; i<nx*ny; i++) cgP[i] = cgZ[i]+beta*cgP[i];
+      }
+    }
+    L.x = cgX;
+  }
+  else { // Stand alone cycling
+    computeResidual(L);
+    residual = sqrt(dot(L.r, L.r))/bNorm;
+    while (tolerance<residual && cycles<maxCycles) {
+      cycle(0);
+      computeResidual(L);
+      residual = sqrt(dot(L.r, L.r))/bNorm;
+      cycles++;
+    }
+  }
+  // Copy back the solution
+  for (int i=0; i<nx*ny; i++)
+    if (L.diag[i]!=0) p[i] = L.x[i];
+  return cycles;
+}
+
+void Multigrid::precondition(const double* r, double* z) {
+  if (levels.empty()) return;
+  int n = levels[0].nx*levels[0].ny;
+  cgR.resize(n);
+  for (int i=0; i<n; i++) cgR[i] = levels[0].diag[i]!=0 ? r[i] : 0;
+  precondition(cgR, cgZ);
+  for (int i=0; i<n; i++) z[i] = cgZ[i];
+}
+
+void Multigrid::coarsen(const Level& fine, Level& coarse) {
+  int nx = fine.nx, ny = fine.ny;
+  int cx = (nx+1)/2, cy = (ny+1)/2;
+  coarse.nx = cx; coarse.ny = cy;
+  coarse.east = coarse.north = coarse.diag = vector<double>(cx*cy, 0);
+  coarse.x = coarse.b = coarse.r = vector<double>(cx*cy, 0);
+  // A link between two points that end up in the same block adds nothing to the coarse operator
+  // (the error is constant on a block), and is taken off the diagonal from both sides
+  for (int y=0; y<ny; y++)
+    for (int x=0; x<nx; x++) {
+      int i = x+nx*y, I = x/2+cx*(y/2);
+      coarse.diag[I] += fine.diag[i];
+      if (0<fine.east[i]) {
+        int xe = x<nx-1 ? x+1 : 0;
+        if (xe/2==x/2) coarse.diag[I] -= 2*fine.east[i];
+        else coarse.east[I] += fine.east[i];
+      }
+      if (0<fine.north[i]) {
+        int yn = y<ny-1 ? y+1 : 0;
+        if (yn/2==y/2) coarse.diag[I] -= 2*fine.north[i];
+        else coarse.north[I] += fine.north[i];
+      }
+    }
+  // Blocks whose diagonal cancelled only have the constant error, which needs no correction
+  double small = 1e-10*(wx+wy);
+  for (int I=0; I<cx*cy; I++)
+    if (coarse.diag[I]<small) coarse.diag[I] = 0;
+}
+
+void Multigrid::cycle(int level) {
+  Level& L = levels[level];
+  if (level+1==static_cast<int>(levels.size())) {
+    smooth(L, coarseSweeps, false);
+    smooth(L, coarseSweeps, true);
+    return;
+  }
+  smooth(L, preSweeps, false);
+  computeResidual(L);
+  // Restrict the residual
+  Level& C = levels[level+1];
+  int nx = L.nx, ny = L.ny, cx = C.nx;
+  for (int I=0; I<C.nx*C.ny; I++) C.b[I] = C.x[I] = 0;
+  for (int y=0; y<ny; y++)
+    for (int x=0; x<nx; x++)
+      C.b[x/2+cx*(y/2)] += L.r[x+nx*y];
+  // Solve for the correction, twice for a W cycle (the coarsest level is solved well enough already)
+  int visits = cycleType==W_CYCLE && level+2<static_cast<int>(levels.size()) ? 2 : 1;
+  for (int v=0; v<visits; v++) cycle(level+1);
+  // Prolong the correction
+  for (int y=0; y<ny; y++)
+    for (int x=0; x<nx; x++) {
+      int i = x+nx*y;
+      if (L.diag[i]!=0) L.x[i] += overcorrection*C.x[x/2+cx*(y/2)];
+    }
+  smooth(L, postSweeps, true);
+}
+
+void Multigrid::precondition(const vector<double>& r, vector<double>& z) {
+  Level& L = levels[0];
+  L.b = r;
+  project(L.b);
+  for (auto& x : L.x) x = 0;
+  cycle(0);
+  z = L.x;
+}
+
+void Multigrid::smooth(Level& L, int sweeps, bool reverse) {
+  int nx = L.nx, ny = L.ny;
+  double *x = &L.x[0], *b = &L.b[0], *east = &L.east[0], *north = &L.north[0], *diag = &L.diag[0];
+  for (int s=0; s<sweeps; s++)
+    for (int c=0; c<2; c++) {
+      int colour = reverse ? 1-c : c;
+      for (int y=0; y<ny; y++) {
+        int yn = y<ny-1 ? y+1 : 0, ys = 0<y ? y-1 : ny-1;
+        for (int X=(y+colour)%2; X<nx; X+=2) {
+          int i = X+nx*y;
+          if (diag[i]==0) continue;
+          int e = (X<nx-1 ? X+1 : 0)+nx*y, w = (0<X ? X-1 : nx-1)+nx*y;
+          int n = X+nx*yn, so = X+nx*ys;
+          x[i] = (b[i] + east[i]*x[e] + east[w]*x[w] + north[i]*x[n] + north[so]*x[so])/diag[i];
+        }
+      }
+    }
+}
+
+void Multigrid::computeResidual(Level& L) {
+  apply(L, L.x, L.r);
+  for (int i=0; i<L.nx*L.ny; i++) L.r[i] = L.b[i]-L.r[i];
+}
+
+void Multigrid::apply(const Level& L, const vector<double>& v, vector<double>& out) {
+  int nx = L.nx, ny = L.ny;
+  out.resize(nx*ny);
+  for (int y=0; y<ny; y++) {
+    int yn = y<ny-1 ? y+1 : 0, ys = 0<y ? y-1 : ny-1;
+    for (int x=0; x<nx; x++) {
+      int i = x+nx*y;
+      int e = (x<nx-1 ? x+1 : 0)+nx*y, w = (0<x ? x-1 : nx-1)+nx*y;
+      int n = x+nx*yn, s = x+nx*ys;
+      out[i] = L.diag[i]==0 ? 0 : L.diag[i]*v[i] - L.east[i]*v[e] - L.east[w]*v[w] - L.north[i]*v[n] - L.north[s]*v[s];
+    }
+  }
+}
+
+void Multigrid::project(vector<double>& v) {
+  // Remove the mean of each region that touches no fixed point
+  if (floating==0) return;
+  const Level& L = levels[0];
+  vector<double> sum(componentSize.size(), 0);
+  for (int i=0; i<L.nx*L.ny; i++)
+    if (component[i]!=-1) sum[component[i]] += v[i];
+  for (size_t c=0; c<sum.size(); c++) sum[c] = componentFloats[c] ? sum[c]/componentSize[c] : 0;
+  for (int i=0; i<L.nx*L.ny; i++)
+    if (component[i]!=-1) v[i] -= sum[component[i]];
+}
+
+bool Multigrid::isSetUp(int nx, int ny, double wx, double wy, const vector<char>& mask, bool wrapX, bool wrapY) const {
+  return !levels.empty() && levels[0].nx==nx && levels[0].ny==ny && this->wx==wx && this->wy==wy && this->wrapX==wrapX && this->wrapY==wrapY && this->mask==mask;
+}
+
+double Multigrid::dot(const vector<double>& a, const vector<double>& b) {
+  double sum = 0;
+  for (size_t i=0; i<a.size(); i++) sum += a[i]*b[i];
+  return sum;
+}
@@ -0,0 +1,108 @@
+/// Geometric multigrid solver for the five point Poisson problem on a masked grid
+///
+
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include "Utility.h"
+
+/// How the coarse levels are visited on each cycle
+enum CycleType { V_CYCLE, W_CYCLE };
+
+/// What a grid point is to the solver
+enum MGCell { MG_FREE, MG_FIXED, MG_EXCLUDED };
+
+/// Solves sum_n w_n (p_n - p) = f at every free point of an nx by ny grid, where n runs over the
+/// neighbours that are not excluded and w_n is wx or wy. Fixed points keep their value (Dirichlet);
+/// excluded points and edges that do not wrap insulate (Neumann). A connected region of free points
+/// with no fixed neighbour is only defined up to a constant, and the part of f that has no solution
+/// there (its mean over the region) is dropped, region by region.
+///
+/// Coarse levels merge 2x2 blocks and add up the links between blocks (Galerkin coarsening with
+/// piecewise constant transfer), so masks of any shape and odd or wrapped grids coarsen the same way.
+/// Piecewise constant prolongation undercorrects smooth errors, so the correction is scaled up. The
+/// smoother is red-black Gauss-Seidel, run in the opposite order after the coarse correction so that a
+/// cycle is a symmetric operator and can precondition conjugate gradient.
+///
+/// W cycles take the same number of cycles at any grid size (under 20 for a 1e-8 reduction, under 10
+/// with conjugate gradient); V cycles are cheaper but need more of them on larger grids. A block that
+/// straddles a one point thick wall gets one correction for both sides, which slows the cycles down,
+/// so by default the cycles precondition conjugate gradient, which recovers most of that.
+class Multigrid {
+ public:
+  Multigrid();
+
+  // Build the levels. The mask is indexed x+nx*y, and may be empty, in which case every point is free
+  void setup(int nx, int ny, double wx, double wy, const vector<char>& mask=vector<char>(), bool wrapX=false, bool wrapY=false);
+
+  // Solve, with p holding the initial guess and the values of the fixed points. Returns the number of cycles
+  int solve(double* p, const double* f);
+
+  // Apply one cycle to r from a zero guess, giving z ~ A^-1 r. For use as a preconditioner
+  void precondition(const double* r, double* z);
+
+  // Accessors
+  int getCycles() const { return cycles; }
+  double getResidual() const { return residual; }
+  int getLevels() const { return levels.size(); }
+  bool isSetUp() const { return !levels.empty(); }
+  // Whether the levels were built with these arguments, so setup can be skipped
+  bool isSetUp(int nx, int ny, double wx, double wy, const vector<char>& mask, bool wrapX, bool wrapY) const;
+
+  // Mutators
+  void setCycleType(CycleType c) { cycleType = c; }
+  void setSweeps(int pre, int post) { preSweeps = pre; postSweeps = post; }
+  void setTolerance(double t) { tolerance = t; }
+  void setMaxCycles(int c) { maxCycles = c; }
+  void setOvercorrection(double a) { overcorrection = a; }
+  void setAccelerate(bool a) { accelerate = a; }
+
+ private:
+  /// One grid of the hierarchy. Each point solves diag*x - sum(link*x_neighbour) = b. The link to the
+  /// west (south) neighbour is stored as that neighbour's east (north) link
+  struct Level {
+    int nx, ny;
+    vector<double> east, north, diag;
+    vector<double> x, b, r;
+  };
+
+  /// Helper functions
+  void coarsen(const Level&, Level&);
+  void cycle(int level);
+  void precondition(const vector<double>& r, vector<double>& z);
+  void smooth(Level&, int sweeps, bool reverse);
+  void computeResidual(Level&);
+  void apply(const Level&, const vector<double>& x, vector<double>& y);
+  void project(vector<double>& v);
+  double dot(const vector<double>&, const vector<double>&);
+
+  /// Data
+  vector<Level> levels;
+  vector<char> fixed;  // Which fine points are fixed
+  vector<char> mask;   // The mask the levels were built from
+  vector<int> component;     // Which connected region of free points each fine point is in, -1 if none
+  vector<int> componentSize;
+  vector<char> componentFloats; // Whether a region touches no fixed point
+  int floating;        // Number of regions that touch no fixed point
+  double wx, wy;
+  bool wrapX, wrapY;
+
+  // Settings
+  CycleType cycleType;
+  int preSweeps, postSweeps;
+  int coarseSweeps;    // Sweeps that stand in for a direct solve on the coarsest level
+  int minSize;         // Stop coarsening once both sides are this small
+  double tolerance;    // Target for |residual|/|right hand side|
+  int maxCycles;
+  double overcorrection;
+  bool accelerate;     // Use the cycles as a preconditioner for conjugate gradient
+
+  // Results of the last solve
+  int cycles;
+  double residual;
+
+  // Conjugate gradient work vectors
+  vector<double> cgX, cgR, cgP, cgQ, cgZ;
+};
+
+#endif // MULTIGRID_H
@@ -1,16 +1,47 @@
 #include "Object.h"
+#include "Integrator.h"
+#include "Checkpoint.h"
 
-Particle::Particle(vect<> pos, double rad, double repulse, double dissipate, double coeff) : position(pos), radius(rad), repulsion(repulse), dissipation(dissipate), coeff(coeff) {
+Particle::Particle(vect<> pos, double rad, double repulse, double dissipate, double coeff) : position(pos), radius(rad), repulsion(repulse), dissipation(dissipate), coeff(coeff), random(globalRandom().key, newId()) {
   initialize();
 }
 
+std::atomic<uint64_t>& Particle::nextId() {
+  static std::atomic<uint64_t> id(0);
+  return id;
+}
+
+uint64_t Particle::newId() {
+  ThreadRandom& R = threadRandom();
+  return R.ownIds ? R.nextId++ : nextId()++;
+}
+
+uint64_t Particle::peekId() {
+  ThreadRandom& R = threadRandom();
+  return R.ownIds ? R.nextId : nextId().load();
+}
+
+void Particle::reserveIds(uint64_t id) {
+  ThreadRandom& R = threadRandom();
+  if (R.ownIds) R.nextId = max(R.nextId, id);
+  else {
+    // Other threads may have handed out ids since, never go back below them
+    uint64_t next = nextId();
+    while (next<id && !nextId().compare_exchange_weak(next, id));
+  }
+}
+
 void Particle::initialize() {
+  type = PASSIVE;
   fixed = false;
   velocity = Zero;
   acceleration = Zero;
   omega = 0;
   alpha = 0;
   theta = 0;
+  jerk = snap = Zero;
+  angJerk = angSnap = 0;
+  step = 0;
   double mass = sphere_mass;
   invMass = 1.0/mass;
   invII = 1.0/(0.5*mass*sqr(radius));
@@ -78,6 +109,41 @@ void Particle::interact(Particle* P, vect<> displacement) {
   }
 }
 
+void Particle::pairInteract(Particle* P, vect<> displacement) {
+  if (fixed && P->fixed) return;
+  double distSqr = sqr(displacement);
+  double cutoff = radius + P->getRadius();
+  double cutoffsqr = sqr(cutoff);
+
+  if (distSqr < cutoffsqr) { // Interaction (same force as interact, using our coefficients)
+    double dist = sqrt(distSqr);
+    vect<> normal = (1.0/dist) * displacement;
+    vect<> shear = vect<>(normal.y, -normal.x);
+    double overlap = 1.0 - dist/cutoff;
+    vect<> dV = P->getVelocity() - velocity;
+    double Vn = dV*normal; // Normal velocity
+    double Vs = dV*shear + radius*omega + P->getTangentialV(); // Shear velocity
+    // Calculate the normal force
+    double Fn = -repulsion*overlap-dissipation*clamp(-Vn); // Damped harmonic oscillator
+    // Calculate the Shear force
+    double Fs = -(coeff*P->getCoeff())*Fn*sign(Vs);
+
+    // Both particles see the same normal and shear forces with opposite signs, and the same torque
+    if (!fixed) {
+      applyNormalForce(Fn*normal);
+      applyShearForce(Fs*shear);
+      applyTorque(-Fs*radius);
+      normForces += Fn;
+    }
+    if (!P->fixed) {
+      P->applyNormalForce(-Fn*normal);
+      P->applyShearForce(-Fs*shear);
+      P->applyTorque(-Fs*P->radius);
+      P->normForces += Fn;
+    }
+  }
+}
+
 void Particle::interact(vect<> pos, double force) {
   if (fixed) return;
   vect<> displacement = position - pos; // Points towards particle
@@ -94,26 +160,11 @@ void Particle::interact(vect<> pos, double force) {
   }
 }
 
-void Particle::update(double epsilon) {
+void Particle::update(double epsilon, const Integrator* integrator) {
   if (fixed) return;
-  // Calculate net force/acceleration, record last acceleration
-  vect<> netF = normalF + shearF + force;
-
-  //vect<> acceleration_t = acceleration;
-  acceleration = invMass*netF;
-
-  // Update velocity and position (velocity verlet) --- V. Verlet seems to conserve energy worse then this
-  position += epsilon*(velocity + 0.5*epsilon*acceleration);
-
-  // velocity += 0.5*epsilon*(acceleration+acceleration_t);
-  velocity += epsilon*acceleration;
-
-  // Update angular variables (velocity verlet)
-  double alpha_t = alpha;
-  alpha = invII*torque;
-  theta += epsilon*(omega + 0.5*epsilon*alpha);
-  // omega += 0.5*epsilon*(alpha+alpha_t);
-  omega += epsilon*alpha;
+  // Move the particle with the forces that act on it now
+  static const Integrator firstOrder;
+  (integrator ? integrator : &firstOrder)->step(this, epsilon);
 
   // Reset forces and torques
   torque = 0;
@@ -144,28 +195,65 @@ void Particle::flowForce(std::function<vect<>(vect<>)> func) {
   flowForce(F);
 }
 
+void Particle::save(std::ostream& out) {
+  writeBinary(out, position); writeBinary(out, velocity); writeBinary(out, acceleration);
+  writeBinary(out, theta); writeBinary(out, omega); writeBinary(out, alpha);
+  writeBinary(out, jerk); writeBinary(out, snap); writeBinary(out, angJerk); writeBinary(out, angSnap); writeBinary(out, step);
+  writeBinary(out, fixed); writeBinary(out, active);
+  writeBinary(out, force); writeBinary(out, normalF); writeBinary(out, shearF); writeBinary(out, torque);
+  writeBinary(out, normForces); writeBinary(out, recentForceAve); writeBinary(out, timeWindow);
+  writeBinary(out, radius); writeBinary(out, invMass); writeBinary(out, invII); writeBinary(out, drag);
+  writeBinary(out, repulsion); writeBinary(out, dissipation); writeBinary(out, coeff);
+  writeBinary(out, random);
+}
+
+void Particle::load(std::istream& in) {
+  readBinary(in, position); readBinary(in, velocity); readBinary(in, acceleration);
+  readBinary(in, theta); readBinary(in, omega); readBinary(in, alpha);
+  readBinary(in, jerk); readBinary(in, snap); readBinary(in, angJerk); readBinary(in, angSnap); readBinary(in, step);
+  readBinary(in, fixed); readBinary(in, active);
+  readBinary(in, force); readBinary(in, normalF); readBinary(in, shearF); readBinary(in, torque);
+  readBinary(in, normForces); readBinary(in, recentForceAve); readBinary(in, timeWindow);
+  readBinary(in, radius); readBinary(in, invMass); readBinary(in, invII); readBinary(in, drag);
+  readBinary(in, repulsion); readBinary(in, dissipation); readBinary(in, coeff);
+  readBinary(in, random);
+}
+
 Bacteria::Bacteria(vect<> pos, double rad, double expTime) : Particle(pos, 0), timer(0), repDelay(default_reproduction_delay) {
   // Since the radius is currently 0, we have to set these radius dependent quantities by hand here.
   invII = 1.0*invMass/(0.5*sqr(rad));
   drag = sphere_drag*rad;
 
+  type = BACTERIA;
   maxRadius = rad;
   dR = expTime>0 ? maxRadius/expTime : rad;
   expansionTime = expTime;
 }
 
-void Bacteria::update(double epsilon) {
+void Bacteria::update(double epsilon, const Integrator* integrator) {
   if (radius<maxRadius) radius += dR*epsilon; // Initial expansion
   else radius = maxRadius;
   if (timer>repDelay) timer = 0;
   timer += epsilon;
-  Particle::update(epsilon);
+  Particle::update(epsilon, integrator);
 }
 
 bool Bacteria::canReproduce() {
   return timer>repDelay;
 }
 
+void Bacteria::save(std::ostream& out) {
+  Particle::save(out);
+  writeBinary(out, dR); writeBinary(out, maxRadius); writeBinary(out, expansionTime);
+  writeBinary(out, timer); writeBinary(out, repDelay);
+}
+
+void Bacteria::load(std::istream& in) {
+  Particle::load(in);
+  readBinary(in, dR); readBinary(in, maxRadius); readBinary(in, expansionTime);
+  readBinary(in, timer); readBinary(in, repDelay);
+}
+
 RTSphere::RTSphere(vect<> pos, double rad) : Particle(pos, rad) {
   initialize();
 };
@@ -186,49 +274,56 @@ void RTSphere::initialize() {
   runForce = default_run_force;
   runTime = default_run;
   tumbleTime = default_tumble;
-  timer = drand48()*(runTime+tumbleTime);
+  timer = random.next()*(runTime+tumbleTime);
   running = timer<runTime;
-  runDirection = randV();
+  runDirection = randV(random);
   bias = 0;
   active = true;
+  type = RTSPHERE;
 }
 
-void RTSphere::update(double epsilon) {
-  if (running) {
-    if (timer<runTime) {
-      applyForce(runForce*runDirection);
-    }
-    else {
-      timer = 0;
-      running = false;
-    }
-  }
-  else {
-    if (timer<tumbleTime); // Do nothing
-    else {
-      timer = 0;
-      running = true;
-      runDirection = randV() + bias;
-    }
-  }
+void RTSphere::update(double epsilon, const Integrator* integrator) {
+  // Run until the run time is up, then tumble until the tumble time is up. The timer and state are
+  // found without branching, only the (rare) start of a run draws a new direction
+  bool endRun = running && timer>=runTime, endTumble = !running && timer>=tumbleTime;
+  double push = running && !endRun;
+  applyForce(push*runForce*runDirection);
+  running = running!=(endRun || endTumble);
+  timer = (endRun || endTumble) ? 0 : timer;
+  if (endTumble) runDirection = randV(random) + bias;
   timer += epsilon;
-  Particle::update(epsilon);
+  Particle::update(epsilon, integrator);
+}
+
+void RTSphere::save(std::ostream& out) {
+  Particle::save(out);
+  writeBinary(out, runTime); writeBinary(out, runForce); writeBinary(out, runDirection);
+  writeBinary(out, bias); writeBinary(out, tumbleTime); writeBinary(out, timer); writeBinary(out, running);
+}
+
+void RTSphere::load(std::istream& in) {
+  Particle::load(in);
+  readBinary(in, runTime); readBinary(in, runForce); readBinary(in, runDirection);
+  readBinary(in, bias); readBinary(in, tumbleTime); readBinary(in, timer); readBinary(in, running);
 }
 
-Wall::Wall(vect<> origin, vect<> end) : origin(origin), wall(end-origin), coeff(wall_coeff), repulsion(wall_repulsion), dissipation(wall_dissipation), gamma(wall_gamma) {
+Wall::Wall(vect<> origin, vect<> end) : origin(origin), wall(end-origin), coeff(wall_coeff), repulsion(wall_repulsion), dissipation(wall_dissipation), gamma(wall_gamma), pressureF(0) {
   normal = wall;
   normal.normalize();
   length = wall.norm();
 }
 
-Wall::Wall(vect<> origin, vect<> wall, bool) : origin(origin), wall(wall), coeff(wall_coeff), repulsion(wall_repulsion), dissipation(wall_dissipation), gamma(wall_gamma) {
+Wall::Wall(vect<> origin, vect<> wall, bool) : origin(origin), wall(wall), coeff(wall_coeff), repulsion(wall_repulsion), dissipation(wall_dissipation), gamma(wall_gamma), pressureF(0) {
   normal = wall;
   normal.normalize();
   length = wall.norm();
 }
 
 void Wall::interact(Particle* P) {
+  pressureF += contact(P);
+}
 
+double Wall::contact(Particle* P) {
   vect<> displacement = P->getPosition() - origin;
   double l_par = displacement*normal;
   vect<> d_par = l_par*normal;
@@ -258,10 +353,34 @@ void Wall::interact(Particle* P) {
     double Fn = -repulsion*overlap-dissipation*(-Vn);
     double Fs = min(fabs((coeff*P->getCoeff())*Fn),fabs(Vs)*gamma)*sign(Vs);
 
-    pressureF += Fn;
-
     P->applyNormalForce(-Fn*normal);
     P->applyShearForce(-Fs*shear);
     P->applyTorque(-Fs*P->getRadius());
+    return Fn;
   }
+  return 0;
+}
+
+double Wall::getDistance(vect<> pos) {
+  vect<> displacement = pos - origin;
+  double l_par = displacement*normal;
+  if (l_par>=0) {
+    if (length>l_par) displacement -= l_par*normal;
+    else displacement -= wall;
+  }
+  return displacement.norm();
+}
+
+void Wall::save(std::ostream& out) {
+  writeBinary(out, coeff); writeBinary(out, origin); writeBinary(out, wall);
+  writeBinary(out, normal); writeBinary(out, length);
+  writeBinary(out, repulsion); writeBinary(out, dissipation); writeBinary(out, gamma);
+  writeBinary(out, pressureF);
+}
+
+void Wall::load(std::istream& in) {
+  readBinary(in, coeff); readBinary(in, origin); readBinary(in, wall);
+  readBinary(in, normal); readBinary(in, length);
+  readBinary(in, repulsion); readBinary(in, dissipation); readBinary(in, gamma);
+  readBinary(in, pressureF);
 }
@@ -23,14 +23,20 @@ const double default_run_force = 5.0;
 const double default_expansion_time = 0.5;
 const double default_reproduction_delay = 0.1;
 
+/// Particle types (each class sets its own, so code can tell them apart without a dynamic_cast)
+enum PType { PASSIVE, RTSPHERE, BACTERIA };
+
 /// Clamp function
 inline double clamp(double x) { return x>0 ? x : 0; }
 
 class Wall; // Forward declaration
+class ParticleArray;
+class Integrator;
 
 class Particle {
  public:
   Particle(vect<> pos, double rad, double repulse=sphere_repulsion, double dissipate=sphere_dissipation, double coeff=sphere_coeff);
+  virtual ~Particle() {}; // Particles are deleted through base pointers
 
   void initialize();
   
@@ -54,6 +60,10 @@ class Particle {
   vect<> getNormalForce() { return normalF; }
   vect<> getShearForce() { return shearF; }
   bool isActive() { return active; }
+  bool isFixed() { return fixed; }
+  PType getType() { return type; }
+  RandomStream& getRandom() { return random; } // This particle's random numbers
+  uint64_t getId() { return random.stream; }
   
   // Mutators
   void setOmega(double om) { omega = om; }
@@ -68,8 +78,9 @@ class Particle {
   /// Control functions
   virtual void interact(Particle*); // Interact with another particle
   virtual void interact(Particle*, vect<>);
+  virtual void pairInteract(Particle*, vect<>); // Interact, applying the equal and opposite force to the other particle
   virtual void interact(vect<> pos, double force);
-  virtual void update(double);
+  virtual void update(double, const Integrator* =0); // Type specific updates, then a step of the integrator (the first order scheme if none)
 
   void flowForce(vect<> F);
   void flowForce(vect<> (*func)(vect<>));
@@ -84,21 +95,40 @@ class Particle {
     acceleration = vect<>();
     omega = 0;
     alpha = 0;
+    jerk = snap = vect<>();
+    angJerk = angSnap = 0;
+    step = 0;
   }
 
   void fix(bool f=true) { fixed = f; }
 
+  // Checkpointing
+  virtual void save(std::ostream&);
+  virtual void load(std::istream&);
+
+  static std::atomic<uint64_t>& nextId(); // Id the next particle created will get (shared by every thread, so ids never repeat)
+  static uint64_t newId();  // Takes an id, from this thread's own count after seedThreadRandom, else from nextId
+  static uint64_t peekId(); // The id newId would give next
+  static void reserveIds(uint64_t); // Makes sure ids below this one are not handed out again
+
   // Exception classes
   class BadMassError {};
   class BadInertiaError {};
 
+  friend class ParticleArray;
+  friend class Integrator;
+
  protected:
   vect<> position;
   vect<> velocity;
   vect<> acceleration;
   double theta, omega, alpha; // Angular variables
+  vect<> jerk, snap;          // Higher derivatives of the acceleration (for the Gear integrator)
+  double angJerk, angSnap;    // "
+  double step;                // Length of the last step (0 before the first, or after a freeze)
   bool fixed; // Whether the particle can move or not
   bool active; // Whether this is an active particle or not
+  PType type;  // Which class this is
 
   // Forces and torques
   vect<> force;
@@ -119,18 +149,25 @@ class Particle {
   double repulsion;   // Coefficient of repulsion
   double dissipation; // Coefficient of dissipation
   double coeff;       // Coefficient of friction
+
+  RandomStream random; // Keyed by the seed and the particle's id
 };
 
 class Bacteria : public Particle {
  public:
   Bacteria(vect<> pos, double rad, double expTime=default_expansion_time);
 
-  virtual void update(double);
+  virtual void update(double, const Integrator* =0);
   bool canReproduce();
   double getRepDelay() { return repDelay; }
   double getMaxRadius() { return maxRadius; }
   void resetTimer() { timer=0; }
 
+  virtual void save(std::ostream&);
+  virtual void load(std::istream&);
+
+  friend class ParticleArray;
+
  private:
   // For expansion
   double dR, maxRadius; 
@@ -146,7 +183,12 @@ class RTSphere : public Particle {
   RTSphere(vect<> pos, double rad, double runF, double=default_run, double=default_tumble, vect<> bias=Zero);
   RTSphere(vect<> pos, double rad, vect<> bias);
 
-  virtual void update(double);
+  virtual void update(double, const Integrator* =0);
+
+  virtual void save(std::ostream&);
+  virtual void load(std::istream&);
+
+  friend class ParticleArray;
 
  private:
 
@@ -179,6 +221,9 @@ class Wall {
   vect<> getPosition() { return origin; }
   vect<> getEnd() { return origin+wall; }
   double getPressure() { return pressureF/length; }
+  double getRepulsion() { return repulsion; }
+  double getDissipation() { return dissipation; }
+  double getDistance(vect<>); // Distance from a point to the wall
 
   /// Mutators
   void setRepulsion(double r) { repulsion = r; }
@@ -186,6 +231,14 @@ class Wall {
   void setCoeff(double c) { coeff = c; }
 
   virtual void interact(Particle*);
+  double contact(Particle*); // Apply the wall's force to a particle, returns the normal force
+  void addPressure(double F) { pressureF += F; }
+
+  // Checkpointing
+  void save(std::ostream&);
+  void load(std::istream&);
+
+  friend class ParticleArray;
 
  private:
   double coeff;  // Coefficient of friction of the wall
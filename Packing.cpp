@@ -0,0 +1,162 @@
+#include "Packing.h"
+
+Packer::Packer(double l, double r, double b, double t) : left(l), right(r), bottom(b), top(t) {
+  stages = 25;
+  maxIters = 5000;
+  tolerance = 1e-3;
+  N = 0;
+  nx = ny = 1;
+  cw = r-l; ch = t-b;
+  phi = maxOverlap = aveOverlap = 0;
+  iters = 0;
+  overlaps = 0;
+  totalOverlap = 0;
+}
+
+void Packer::addWall(Wall* W) {
+  walls.push_back(pair<vect<>, vect<> >(W->getPosition(), W->getEnd()));
+}
+
+vector<vect<> > Packer::pack(int number, double R) {
+  N = number;
+  iters = 0;
+  px.resize(N); py.resize(N);
+  vx.assign(N, 0); vy.assign(N, 0);
+  fx.assign(N, 0); fy.assign(N, 0);
+  // Cells at least one full diameter wide
+  nx = max(1, static_cast<int>((right-left)/(2*R)));
+  ny = max(1, static_cast<int>((top-bottom)/(2*R)));
+  cw = (right-left)/nx; ch = (top-bottom)/ny;
+  cells.setCells(nx*ny);
+  cellOf.resize(N);
+
+  // Start with small discs at random positions
+  double r0 = 0.05*R;
+  for (int i=0; i<N; i++) {
+    px[i] = left + r0 + (right-left-2*r0)*getRand();
+    py[i] = bottom + r0 + (top-bottom-2*r0)*getRand();
+  }
+  // Inflate in stages, relaxing the overlaps after each one
+  int stageIters = max(50, maxIters/stages);
+  for (int s=1; s<=stages; s++) minimize(r0 + (R-r0)*s/stages, stageIters);
+  minimize(R, maxIters);
+  measure(R);
+
+  vector<vect<> > pos;
+  for (int i=0; i<N; i++) pos.push_back(vect<>(px[i], py[i]));
+  return pos;
+}
+
+inline void Packer::minimize(double r, int iterations) {
+  // FIRE parameters (unit mass and stiffness, so the natural time scale is 1)
+  double dt = 0.1, dtMax = 0.5, alpha = 0.1;
+  int positive = 0;
+  for (int it=0; it<iterations; it++) {
+    double overlap = forces(r);
+    iters++;
+    if (overlap<tolerance) break;
+    // Power, and the norms of the force and velocity
+    double P = 0, F = 0, V = 0;
+    for (int i=0; i<N; i++) {
+      P += fx[i]*vx[i] + fy[i]*vy[i];
+      F += sqr(fx[i]) + sqr(fy[i]);
+      V += sqr(vx[i]) + sqr(vy[i]);
+    }
+    if (P>0) { // Going downhill, steer the velocity towards the force and speed up
+      double mix = F>0 ? alpha*sqrt(V/F) : 0;
+      for (int i=0; i<N; i++) {
+	vx[i] = (1-alpha)*vx[i] + mix*fx[i];
+	vy[i] = (1-alpha)*vy[i] + mix*fy[i];
+      }
+      if (++positive>5) {
+	dt = min(1.1*dt, dtMax);
+	alpha *= 0.99;
+      }
+    }
+    else { // Going uphill, stop and slow down
+      for (int i=0; i<N; i++) vx[i] = vy[i] = 0;
+      dt *= 0.5;
+      alpha = 0.1;
+      positive = 0;
+    }
+    // Semi-implicit Euler step
+    for (int i=0; i<N; i++) {
+      vx[i] += dt*fx[i]; vy[i] += dt*fy[i];
+      px[i] += dt*vx[i]; py[i] += dt*vy[i];
+    }
+  }
+}
+
+inline double Packer::forces(double r) {
+  for (int i=0; i<N; i++) fx[i] = fy[i] = 0;
+  maxOverlap = 0;
+  // Sort the discs into cells
+  for (int i=0; i<N; i++) {
+    int X = static_cast<int>((px[i]-left)/cw), Y = static_cast<int>((py[i]-bottom)/ch);
+    X = X<0 ? 0 : (X>=nx ? nx-1 : X);
+    Y = Y<0 ? 0 : (Y>=ny ? ny-1 : Y);
+    cellOf[i] = X + nx*Y;
+  }
+  cells.build(cellOf);
+  // Each pair of neighboring cells once: the same cell, the cell to the right, and the three above
+  for (int Y=0; Y<ny; Y++)
+    for (int X=0; X<nx; X++) {
+      int c = X + nx*Y;
+      for (int k=cells.begin(c); k<cells.end(c); k++) {
+	int i = cells.at(k);
+	for (int l=k+1; l<cells.end(c); l++) pairForce(i, cells.at(l), r);
+	int nb[4][2] = {{X+1,Y}, {X-1,Y+1}, {X,Y+1}, {X+1,Y+1}};
+	for (int n=0; n<4; n++) {
+	  if (nb[n][0]<0 || nb[n][0]>=nx || nb[n][1]>=ny) continue;
+	  int d = nb[n][0] + nx*nb[n][1];
+	  for (int l=cells.begin(d); l<cells.end(d); l++) pairForce(i, cells.at(l), r);
+	}
+      }
+    }
+  // Edges of the region and obstacles
+  for (int i=0; i<N; i++) {
+    double ov;
+    if ((ov = left-(px[i]-r))>0) { fx[i] += ov; maxOverlap = max(maxOverlap, ov/(2*r)); }
+    if ((ov = px[i]+r-right)>0) { fx[i] -= ov; maxOverlap = max(maxOverlap, ov/(2*r)); }
+    if ((ov = bottom-(py[i]-r))>0) { fy[i] += ov; maxOverlap = max(maxOverlap, ov/(2*r)); }
+    if ((ov = py[i]+r-top)>0) { fy[i] -= ov; maxOverlap = max(maxOverlap, ov/(2*r)); }
+    for (auto &W : walls) {
+      // Nearest point on the wall
+      vect<> a = W.first, ab = W.second-W.first, p(px[i], py[i]);
+      double lsqr = sqr(ab), t = lsqr>0 ? ((p-a)*ab)/lsqr : 0;
+      t = t<0 ? 0 : (t>1 ? 1 : t);
+      vect<> d = p-(a+t*ab);
+      double dist = sqrt(sqr(d));
+      if (dist<r && dist>0) {
+	ov = r-dist;
+	fx[i] += ov*d.x/dist;
+	fy[i] += ov*d.y/dist;
+	maxOverlap = max(maxOverlap, ov/(2*r));
+      }
+    }
+  }
+  return maxOverlap;
+}
+
+inline void Packer::pairForce(int i, int j, double r) {
+  double dx = px[i]-px[j], dy = py[i]-py[j];
+  double distSqr = dx*dx+dy*dy;
+  if (distSqr>=4*r*r) return;
+  double dist = sqrt(distSqr);
+  // Discs at the same point get pushed apart in an arbitrary direction
+  double nX = dist>0 ? dx/dist : 1, nY = dist>0 ? dy/dist : 0;
+  double ov = 2*r-dist;
+  fx[i] += ov*nX; fy[i] += ov*nY;
+  fx[j] -= ov*nX; fy[j] -= ov*nY;
+  maxOverlap = max(maxOverlap, ov/(2*r));
+  overlaps++;
+  totalOverlap += ov/(2*r);
+}
+
+inline void Packer::measure(double r) {
+  overlaps = 0;
+  totalOverlap = 0;
+  forces(r);
+  aveOverlap = overlaps>0 ? totalOverlap/overlaps : 0;
+  phi = N*PI*sqr(r)/((right-left)*(top-bottom));
+}
@@ -0,0 +1,57 @@
+/// Header for Packing.h
+/// Finds positions for discs at high packing fractions. The discs start small at random positions and
+/// are inflated in stages, and after each stage the soft overlap energy is minimized with FIRE. Contacts
+/// are found with a CellList, so every iteration is linear in the number of discs.
+
+#ifndef PACKING_H
+#define PACKING_H
+
+#include "Object.h"
+#include "CellList.h"
+
+class Packer {
+ public:
+  Packer(double left, double right, double bottom, double top);
+
+  void addWall(Wall*); // An obstacle the discs should not overlap (the edges of the region always are)
+  vector<vect<> > pack(int N, double R); // Positions for N discs of radius R
+
+  // Mutators
+  void setStages(int s) { stages = s>0 ? s : 1; }
+  void setMaxIters(int i) { maxIters = i; }
+  void setTolerance(double t) { tolerance = t; }
+
+  // Results of the last packing
+  double getPhi() { return phi; }               // Packing fraction
+  double getMaxOverlap() { return maxOverlap; } // Largest overlap, as a fraction of the contact distance
+  double getAveOverlap() { return aveOverlap; } // Average overlap of the pairs that overlap
+  int getIters() { return iters; }              // Total number of minimization steps
+
+ private:
+  inline void minimize(double r, int iterations); // FIRE minimization with radius r
+  inline double forces(double r); // Overlap forces, returns the largest relative overlap
+  inline void pairForce(int i, int j, double r);
+  inline void measure(double r); // Find the overlap statistics
+
+  double left, right, bottom, top;
+  vector<pair<vect<>, vect<> > > walls; // Ends of the obstacles
+  int stages;       // Number of inflation stages
+  int maxIters;     // Most minimization steps for the final radius
+  double tolerance; // Relative overlap at which we stop minimizing
+
+  // Disc data
+  int N;
+  vector<double> px, py, vx, vy, fx, fy;
+  CellList cells;
+  vector<int> cellOf;
+  int nx, ny; // Number of cells
+  double cw, ch; // Cell width and height
+
+  // Results
+  double phi, maxOverlap, aveOverlap;
+  int iters;
+  int overlaps; // Number of overlapping pairs, while measuring
+  double totalOverlap;
+};
+
+#endif
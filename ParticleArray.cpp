@@ -0,0 +1,377 @@
+#include "ParticleArray.h"
+
+ParticleArray::ParticleArray() : N(0), capacity(0) {
+  px = py = vx = vy = ax = ay = 0;
+  th = om = al = 0;
+  step = 0;
+  fx = fy = tq = 0;
+  rad = invMass = invII = drag = repulsion = dissipation = coeff = 0;
+  mobile = 0;
+  scratch = 0;
+}
+
+ParticleArray::~ParticleArray() {
+  discard();
+}
+
+void ParticleArray::load(list<Particle*>& particles) {
+  int size = particles.size();
+  if (size>capacity) allocate(size);
+  N = size;
+  owner.clear();
+  rtIndex.clear(); rtTimer.clear(); rtRunTime.clear(); rtTumbleTime.clear(); rtRunForce.clear();
+  rtDirection.clear(); rtBias.clear(); rtRunning.clear();
+  bIndex.clear(); bTimer.clear(); bMaxRadius.clear(); bDR.clear(); bRepDelay.clear();
+
+  int i = 0;
+  for (auto P : particles) {
+    owner.push_back(P);
+    px[i] = P->position.x; py[i] = P->position.y;
+    vx[i] = P->velocity.x; vy[i] = P->velocity.y;
+    ax[i] = P->acceleration.x; ay[i] = P->acceleration.y;
+    th[i] = P->theta; om[i] = P->omega; al[i] = P->alpha;
+    step[i] = P->step;
+    fx[i] = P->normalF.x + P->shearF.x + P->force.x;
+    fy[i] = P->normalF.y + P->shearF.y + P->force.y;
+    tq[i] = P->torque;
+    rad[i] = P->radius;
+    invMass[i] = P->invMass;
+    invII[i] = P->invII;
+    drag[i] = P->drag;
+    repulsion[i] = P->repulsion;
+    dissipation[i] = P->dissipation;
+    coeff[i] = P->coeff;
+    mobile[i] = P->fixed ? 0 : 1;
+    // Type specific data
+    if (P->type==RTSPHERE) {
+      RTSphere *R = static_cast<RTSphere*>(P);
+      rtIndex.push_back(i);
+      rtTimer.push_back(R->timer);
+      rtRunTime.push_back(R->runTime);
+      rtTumbleTime.push_back(R->tumbleTime);
+      rtRunForce.push_back(R->runForce);
+      rtDirection.push_back(R->runDirection);
+      rtBias.push_back(R->bias);
+      rtRunning.push_back(R->running);
+    }
+    if (P->type==BACTERIA) {
+      Bacteria *B = static_cast<Bacteria*>(P);
+      bIndex.push_back(i);
+      bTimer.push_back(B->timer);
+      bMaxRadius.push_back(B->maxRadius);
+      bDR.push_back(B->dR);
+      bRepDelay.push_back(B->repDelay);
+    }
+    i++;
+  }
+}
+
+void ParticleArray::store() {
+  for (int i=0; i<N; i++) {
+    Particle *P = owner.at(i);
+    P->position = vect<>(px[i], py[i]);
+    P->velocity = vect<>(vx[i], vy[i]);
+    P->acceleration = vect<>(ax[i], ay[i]);
+    P->theta = th[i]; P->omega = om[i]; P->alpha = al[i];
+    P->step = step[i];
+    P->normalF = P->shearF = Zero;
+    P->force = vect<>(fx[i], fy[i]);
+    P->torque = tq[i];
+    P->radius = rad[i];
+  }
+  for (size_t k=0; k<rtIndex.size(); k++) {
+    RTSphere *R = static_cast<RTSphere*>(owner.at(rtIndex.at(k)));
+    R->timer = rtTimer.at(k);
+    R->runDirection = rtDirection.at(k);
+    R->running = rtRunning.at(k);
+  }
+  for (size_t k=0; k<bIndex.size(); k++) {
+    Bacteria *B = static_cast<Bacteria*>(owner.at(bIndex.at(k)));
+    B->timer = bTimer.at(k);
+  }
+}
+
+void ParticleArray::freeze(int i) {
+  vx[i] = vy[i] = 0;
+  ax[i] = ay[i] = 0;
+  om[i] = 0;
+  al[i] = 0;
+  step[i] = 0;
+}
+
+void ParticleArray::reorder(const vector<int>& order) {
+  permute(px, order); permute(py, order);
+  permute(vx, order); permute(vy, order);
+  permute(ax, order); permute(ay, order);
+  permute(th, order); permute(om, order); permute(al, order);
+  permute(step, order);
+  permute(fx, order); permute(fy, order); permute(tq, order);
+  permute(rad, order);
+  permute(invMass, order); permute(invII, order);
+  permute(drag, order);
+  permute(repulsion, order); permute(dissipation, order);
+  permute(coeff, order);
+  permute(mobile, order);
+  ownerScratch.resize(N);
+  inverse.resize(N);
+  for (int k=0; k<N; k++) {
+    ownerScratch[k] = owner[order[k]];
+    inverse[order[k]] = k;
+  }
+  owner.swap(ownerScratch);
+  // The run and tumble and bacteria data stay where they are, only the entries they refer to move
+  for (auto &i : rtIndex) i = inverse[i];
+  for (auto &i : bIndex) i = inverse[i];
+}
+
+void ParticleArray::applyGravity(vect<> g) {
+  for (int i=0; i<N; i++) {
+    double mass = 1.0/invMass[i];
+    fx[i] += mass*g.x;
+    fy[i] += mass*g.y;
+  }
+}
+
+void ParticleArray::flowForce(int i, vect<> F) {
+  // A current is pushing on the particle
+  vect<> diff = F-vect<>(vx[i], vy[i]);
+  double dsqr = sqr(diff);
+  diff.normalize();
+  fx[i] += drag[i]*dsqr*diff.x;
+  fy[i] += drag[i]*dsqr*diff.y;
+}
+
+void ParticleArray::interact(int i, int j, vect<> displacement) {
+  // Same force law as Particle::interact
+  double distSqr = sqr(displacement);
+  double cutoff = rad[i] + rad[j];
+  if (mobile[i]==0 || cutoff*cutoff<=distSqr) return;
+  double dist = sqrt(distSqr);
+  vect<> normal = (1.0/dist) * displacement;
+  vect<> shear = vect<>(normal.y, -normal.x);
+  double overlap = 1.0 - dist/cutoff;
+  vect<> dV = vect<>(vx[j]-vx[i], vy[j]-vy[i]);
+  double Vn = dV*normal; // Normal velocity
+  double Vs = dV*shear + rad[i]*om[i] + rad[j]*om[j]; // Shear velocity
+  double Fn = -repulsion[i]*overlap-dissipation[i]*clamp(-Vn);
+  double Fs = -(coeff[i]*coeff[j])*Fn*sign(Vs);
+  fx[i] += Fn*normal.x + Fs*shear.x;
+  fy[i] += Fn*normal.y + Fs*shear.y;
+  tq[i] -= Fs*rad[i];
+}
+
+void ParticleArray::pairInteract(int i, int j, vect<> displacement) {
+  // Same force law as Particle::pairInteract
+  double distSqr = sqr(displacement);
+  double cutoff = rad[i] + rad[j];
+  if (cutoff*cutoff<=distSqr) return;
+  double dist = sqrt(distSqr);
+  vect<> normal = (1.0/dist) * displacement;
+  vect<> shear = vect<>(normal.y, -normal.x);
+  double overlap = 1.0 - dist/cutoff;
+  vect<> dV = vect<>(vx[j]-vx[i], vy[j]-vy[i]);
+  double Vn = dV*normal; // Normal velocity
+  double Vs = dV*shear + rad[i]*om[i] + rad[j]*om[j]; // Shear velocity
+  double Fn = -repulsion[i]*overlap-dissipation[i]*clamp(-Vn);
+  double Fs = -(coeff[i]*coeff[j])*Fn*sign(Vs);
+  double Fx = Fn*normal.x + Fs*shear.x, Fy = Fn*normal.y + Fs*shear.y;
+  // Forces on fixed particles are never used, so there is no need to mask them out
+  fx[i] += Fx; fy[i] += Fy;
+  tq[i] -= Fs*rad[i];
+  fx[j] -= Fx; fy[j] -= Fy;
+  tq[j] -= Fs*rad[j];
+}
+
+void ParticleArray::interactBlock(int i, ContactBlock& block) {
+  // Same force law as interact, but pairs out of range are masked (they get zero force) instead of
+  // branched on, so the loop vectorizes
+  if (mobile[i]==0) return;
+  int n = block.size();
+  const int *J = block.index.data();
+  const double *DX = block.dx.data(), *DY = block.dy.data();
+  double ri = rad[i], vxi = vx[i], vyi = vy[i], wi = ri*om[i];
+  double rep = repulsion[i], dis = dissipation[i], ci = coeff[i];
+  double Fx = 0, Fy = 0, T = 0;
+#pragma omp simd reduction(+:Fx,Fy,T)
+  for (int k=0; k<n; k++) {
+    int j = J[k];
+    double distSqr = DX[k]*DX[k] + DY[k]*DY[k];
+    double cutoff = ri + rad[j];
+    double mask = distSqr<cutoff*cutoff ? 1. : 0.;
+    double dist = sqrt(distSqr);
+    double invDist = mask/(dist + (1.-mask)); // Zero for masked pairs, so the normal is zero
+    double nx = DX[k]*invDist, ny = DY[k]*invDist;
+    double overlap = mask*(1.0 - dist/cutoff);
+    double dVx = vx[j]-vxi, dVy = vy[j]-vyi;
+    double Vn = dVx*nx + dVy*ny;
+    double Vs = dVx*ny - dVy*nx + wi + rad[j]*om[j];
+    double Fn = -rep*overlap - dis*(Vn<0 ? -Vn : 0.);
+    double Fs = -(ci*coeff[j])*Fn*((Vs>0 ? 1. : 0.) - (Vs<0 ? 1. : 0.));
+    Fx += Fn*nx + Fs*ny;
+    Fy += Fn*ny - Fs*nx;
+    T -= Fs*ri;
+  }
+  fx[i] += Fx; fy[i] += Fy;
+  tq[i] += T;
+}
+
+void ParticleArray::pairBlock(int i, ContactBlock& block) {
+  // Same force law as pairInteract, masked like interactBlock. The candidates in a block are
+  // distinct, so the writes to them do not conflict
+  int n = block.size();
+  const int *J = block.index.data();
+  const double *DX = block.dx.data(), *DY = block.dy.data();
+  double ri = rad[i], vxi = vx[i], vyi = vy[i], wi = ri*om[i];
+  double rep = repulsion[i], dis = dissipation[i], ci = coeff[i];
+  double Fx = 0, Fy = 0, T = 0;
+#pragma omp simd reduction(+:Fx,Fy,T)
+  for (int k=0; k<n; k++) {
+    int j = J[k];
+    double distSqr = DX[k]*DX[k] + DY[k]*DY[k];
+    double cutoff = ri + rad[j];
+    double mask = distSqr<cutoff*cutoff ? 1. : 0.;
+    double dist = sqrt(distSqr);
+    double invDist = mask/(dist + (1.-mask));
+    double nx = DX[k]*invDist, ny = DY[k]*invDist;
+    double overlap = mask*(1.0 - dist/cutoff);
+    double dVx = vx[j]-vxi, dVy = vy[j]-vyi;
+    double Vn = dVx*nx + dVy*ny;
+    double Vs = dVx*ny - dVy*nx + wi + rad[j]*om[j];
+    double Fn = -rep*overlap - dis*(Vn<0 ? -Vn : 0.);
+    double Fs = -(ci*coeff[j])*Fn*((Vs>0 ? 1. : 0.) - (Vs<0 ? 1. : 0.));
+    double fX = Fn*nx + Fs*ny, fY = Fn*ny - Fs*nx;
+    Fx += fX; Fy += fY;
+    T -= Fs*ri;
+    fx[j] -= fX; fy[j] -= fY;
+    tq[j] -= Fs*rad[j];
+  }
+  fx[i] += Fx; fy[i] += Fy;
+  tq[i] += T;
+}
+
+double ParticleArray::wallInteract(Wall* W, int i) {
+  // Same force law as Wall::interact
+  vect<> displacement = vect<>(px[i], py[i]) - W->origin;
+  double l_par = displacement*W->normal;
+  vect<> d_par = l_par*W->normal;
+  vect<> d_perp = displacement - d_par;
+  double radSqr = sqr(rad[i]);
+  if (l_par>=0) {
+    if (W->length>l_par) displacement = d_perp;
+    else displacement -= W->wall;
+  }
+  double distSqr = sqr(displacement);
+  if (distSqr<=radSqr) {
+    double dist = sqrt(distSqr);
+    vect<> normal = (1.0/dist) * displacement;
+    vect<> shear = vect<>(normal.y, -normal.x);
+    double overlap = 1.0 - dist/rad[i];
+    vect<> V(vx[i], vy[i]);
+    double Vn = V*normal;
+    double Vs = V*shear + om[i]*rad[i];
+    double Fn = -W->repulsion*overlap-W->dissipation*(-Vn);
+    double Fs = min(fabs((W->coeff*coeff[i])*Fn),fabs(Vs)*W->gamma)*sign(Vs);
+    fx[i] -= Fn*normal.x + Fs*shear.x;
+    fy[i] -= Fn*normal.y + Fs*shear.y;
+    tq[i] -= Fs*rad[i];
+    return Fn;
+  }
+  return 0;
+}
+
+void ParticleArray::update(double epsilon, IntegratorType type) {
+  // Type specific updates
+  rtUpdate(epsilon);
+  bacteriaUpdate(epsilon);
+  // Integrate (same schemes as Integrator). Fixed particles are masked out rather
+  // than branched on so this loop can be vectorized
+  double v = type==VELOCITY_VERLET ? 0.5 : 0; // Velocity verlet corrects the predicted velocity with the new acceleration
+  for (int i=0; i<N; i++) {
+    double m = mobile[i], e = m*epsilon, h = m*v*step[i];
+    double accx = invMass[i]*fx[i], accy = invMass[i]*fy[i], alp = invII[i]*tq[i];
+    vx[i] += h*(accx - ax[i]);
+    vy[i] += h*(accy - ay[i]);
+    om[i] += h*(alp - al[i]);
+    ax[i] = m*accx + (1-m)*ax[i];
+    ay[i] = m*accy + (1-m)*ay[i];
+    px[i] += e*(vx[i] + 0.5*epsilon*ax[i]);
+    py[i] += e*(vy[i] + 0.5*epsilon*ay[i]);
+    vx[i] += e*ax[i];
+    vy[i] += e*ay[i];
+    al[i] = m*alp + (1-m)*al[i];
+    th[i] += e*(om[i] + 0.5*epsilon*al[i]);
+    om[i] += e*al[i];
+    step[i] = m*epsilon + (1-m)*step[i];
+    // Reset forces and torques
+    fx[i] = fy[i] = tq[i] = 0;
+  }
+}
+
+inline void ParticleArray::allocate(int size) {
+  discard();
+  capacity = size;
+  px = aligned_new<double>(size); py = aligned_new<double>(size);
+  vx = aligned_new<double>(size); vy = aligned_new<double>(size);
+  ax = aligned_new<double>(size); ay = aligned_new<double>(size);
+  th = aligned_new<double>(size); om = aligned_new<double>(size); al = aligned_new<double>(size);
+  step = aligned_new<double>(size);
+  fx = aligned_new<double>(size); fy = aligned_new<double>(size); tq = aligned_new<double>(size);
+  rad = aligned_new<double>(size);
+  invMass = aligned_new<double>(size); invII = aligned_new<double>(size);
+  drag = aligned_new<double>(size);
+  repulsion = aligned_new<double>(size); dissipation = aligned_new<double>(size);
+  coeff = aligned_new<double>(size);
+  mobile = aligned_new<double>(size);
+  scratch = aligned_new<double>(size);
+}
+
+inline void ParticleArray::discard() {
+  aligned_delete(px); aligned_delete(py);
+  aligned_delete(vx); aligned_delete(vy);
+  aligned_delete(ax); aligned_delete(ay);
+  aligned_delete(th); aligned_delete(om); aligned_delete(al);
+  aligned_delete(step);
+  aligned_delete(fx); aligned_delete(fy); aligned_delete(tq);
+  aligned_delete(rad);
+  aligned_delete(invMass); aligned_delete(invII);
+  aligned_delete(drag);
+  aligned_delete(repulsion); aligned_delete(dissipation);
+  aligned_delete(coeff);
+  aligned_delete(mobile);
+  aligned_delete(scratch);
+  N = capacity = 0;
+}
+
+inline void ParticleArray::permute(double* &data, const vector<int>& order) {
+  for (int k=0; k<N; k++) scratch[k] = data[order[k]];
+  std::swap(data, scratch);
+}
+
+inline void ParticleArray::rtUpdate(double epsilon) {
+  // Same logic as RTSphere::update, without branches. Runs that start need a new direction, which is
+  // drawn from the particle's stream afterwards
+  int R = rtIndex.size();
+  rtTumbled.clear();
+  for (int k=0; k<R; k++) {
+    int i = rtIndex[k];
+    bool running = rtRunning[k];
+    bool endRun = running && rtTimer[k]>=rtRunTime[k], endTumble = !running && rtTimer[k]>=rtTumbleTime[k];
+    double push = (running && !endRun)*rtRunForce[k];
+    fx[i] += push*rtDirection[k].x;
+    fy[i] += push*rtDirection[k].y;
+    rtRunning[k] = running!=(endRun || endTumble);
+    rtTimer[k] = (endRun || endTumble) ? epsilon : rtTimer[k]+epsilon;
+    if (endTumble) rtTumbled.push_back(k);
+  }
+  for (auto k : rtTumbled) rtDirection[k] = randV(owner[rtIndex[k]]->getRandom()) + rtBias[k];
+}
+
+inline void ParticleArray::bacteriaUpdate(double epsilon) {
+  for (size_t k=0; k<bIndex.size(); k++) {
+    int i = bIndex[k];
+    if (rad[i]<bMaxRadius[k]) rad[i] += bDR[k]*epsilon; // Initial expansion
+    else rad[i] = bMaxRadius[k];
+    if (bTimer[k]>bRepDelay[k]) bTimer[k] = 0;
+    bTimer[k] += epsilon;
+  }
+}
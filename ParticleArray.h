@@ -0,0 +1,86 @@
+/// Header for ParticleArray.h
+/// Structure-of-arrays storage for particle state, so the force and update loops
+/// run over contiguous, aligned memory instead of chasing Particle pointers.
+
+#ifndef PARTICLE_ARRAY_H
+#define PARTICLE_ARRAY_H
+
+#include "Integrator.h"
+
+/// A packed block of neighbor candidates for one particle, for the vector kernels
+struct ContactBlock {
+  void clear() { index.clear(); dx.clear(); dy.clear(); }
+  void add(int j, vect<> d) { index.push_back(j); dx.push_back(d.x); dy.push_back(d.y); }
+  int size() { return index.size(); }
+  vector<int> index;     // The candidates
+  vector<double> dx, dy; // Displacement from the particle to each candidate
+};
+
+class ParticleArray {
+ public:
+  ParticleArray();
+  ~ParticleArray();
+
+  // Loading and storing
+  void load(list<Particle*>&); // Copy the state of the particles into the arrays
+  void store();                // Write the state in the arrays back to the particles
+
+  // Accessors
+  int size() { return N; }
+  Particle* getParticle(int i) { return owner.at(i); }
+  vect<> getPosition(int i) { return vect<>(px[i], py[i]); }
+  vect<> getVelocity(int i) { return vect<>(vx[i], vy[i]); }
+  vect<> getAcceleration(int i) { return vect<>(ax[i], ay[i]); }
+  double getRadius(int i) { return rad[i]; }
+  double getMass(int i) { return 1.0/invMass[i]; }
+  double getKE(int i) { return 0.5*((sqr(vx[i])+sqr(vy[i]))/invMass[i] + sqr(om[i])/invII[i]); }
+
+  // Mutators
+  void setPosition(int i, vect<> pos) { px[i] = pos.x; py[i] = pos.y; }
+  void freeze(int i);
+  void reorder(const vector<int>& order); // Entry k becomes the old entry order[k]
+
+  /// Kernels
+  void applyGravity(vect<> g);
+  void flowForce(int i, vect<> F);
+  void interact(int i, int j, vect<> displacement); // Force on i due to j
+  void pairInteract(int i, int j, vect<> displacement); // Force on i due to j, and the opposite force on j
+  void interactBlock(int i, ContactBlock&); // Vectorized interact with every candidate in the block
+  void pairBlock(int i, ContactBlock&);     // Vectorized pairInteract with every candidate in the block
+  double wallInteract(Wall*, int i); // Returns the normal force (for the wall's pressure)
+  void update(double epsilon, IntegratorType=EULER); // Type specific updates and integration (EULER or VELOCITY_VERLET)
+
+  /// The actual data
+  double *px, *py, *vx, *vy, *ax, *ay; // Linear variables
+  double *th, *om, *al;                // Angular variables
+  double *step;                        // Length of each particle's last step
+  double *fx, *fy, *tq;                // Net force and torque
+  double *rad, *invMass, *invII, *drag, *repulsion, *dissipation, *coeff;
+  double *mobile; // 1 if the particle can move, 0 if it is fixed
+
+ private:
+  inline void allocate(int);
+  inline void discard();
+  inline void permute(double*&, const vector<int>&);
+  inline void rtUpdate(double);
+  inline void bacteriaUpdate(double);
+
+  int N, capacity;
+  double *scratch; // Spare array, swapped with the data arrays when reordering
+  vector<Particle*> ownerScratch;
+  vector<int> inverse; // Where each old entry went, when reordering
+  vector<Particle*> owner; // The particle each entry was loaded from
+
+  /// Run and tumble data (indexed by position in rtIndex)
+  vector<int> rtIndex;
+  vector<double> rtTimer, rtRunTime, rtTumbleTime, rtRunForce;
+  vector<vect<> > rtDirection, rtBias;
+  vector<char> rtRunning;
+  vector<int> rtTumbled; // The spheres that start a new run this step
+
+  /// Bacteria data (indexed by position in bIndex)
+  vector<int> bIndex;
+  vector<double> bTimer, bMaxRadius, bDR, bRepDelay;
+};
+
+#endif
@@ -1,6 +1,6 @@
 #include "Simulator.h"
 
-Simulator::Simulator() : lastDisp(0), dispTime(1./15.), dispFactor(1), time(0), iter(0), bottom(0), top(1.0), yTop(1.0), left(0), right(1.0), minepsilon(default_epsilon), gravity(vect<>(0, -3)), markWatch(false), startRecording(0), stopRecording(1e9), startTime(1), delayTime(5), maxIters(-1), recAllIters(false), runTime(0), recIt(0), temperature(0), samplePoints(100), resourceDiffusion(50.), wasteDiffusion(50.), secretionRate(1.), eatRate(1.), recFields(false), replenish(0), wasteSource(0) {
+Simulator::Simulator() : lastDisp(0), dispTime(1./15.), dispFactor(1), time(0), iter(0), bottom(0), top(1.0), yTop(1.0), left(0), right(1.0), minepsilon(default_epsilon), gravity(vect<>(0, -3)), markWatch(false), startRecording(0), stopRecording(1e9), startTime(1), delayTime(5), maxIters(-1), keepStatRecords(true), recAllIters(false), runTime(0), recIt(0), temperature(0), obsValid(0), samplePoints(100), resourceDiffusion(50.), wasteDiffusion(50.), spectralDiffusion(false), secretionRate(1.), eatRate(1.), recFields(false), replenish(0), wasteSource(0) {
   // Flow
   hasDrag = true;
   flowFunc = 0;
@@ -9,6 +9,13 @@ Simulator::Simulator() : lastDisp(0), dispTime(1./15.), dispFactor(1), time(0),
   epsilon = default_epsilon;
   min_epsilon = 1e-7;
   adjust_epsilon = false;
+  adaptive = false;
+  maxSubsteps = 8;
+  substeps = 1;
+  max_epsilon = 1e-3;
+  stepTolerance = 1e-6;
+  adaptiveTime = fixedSteps = 0;
+  adaptiveSteps = 0;
   // Boundary conditions
   xLBound = WRAP;
   xRBound = WRAP;
@@ -17,8 +24,43 @@ Simulator::Simulator() : lastDisp(0), dispTime(1./15.), dispFactor(1), time(0),
   // Sectorization
   sectorize = true;
   ssecInteract = false;
+  pairHalving = true;
   secX = 10; secY = 10;
-  sectors = new list<Particle*>[(secX+2)*(secY+2)+1];
+  cells.setCells((secX+2)*(secY+2)+1);
+  sectorsDirty = true;
+  batchesDirty = true;
+  // Packing
+  packPhi = packOverlap = 0;
+  // Overlap grid
+  overlapDirty = true;
+  // Wall index
+  wallRadius = 0;
+  wallsDirty = true;
+  // Verlet lists
+  verlet = false;
+  verletDirty = true;
+  skinDepth = 0.01;
+  verletRebuilds = 0;
+  // Particle arrays
+  useArrays = false;
+  arraysActive = false;
+  reorderArrays = true;
+  vectorKernel = false;
+  // Spatial reordering
+  reorderInterval = 0;
+  reorderCurve = HILBERT;
+  reorders = 0;
+  // Multithreading
+  nThreads = 1;
+  // Checkpointing
+  checkpointInterval = 0;
+  lastCheckpoint = 0;
+  resuming = false;
+  // Asynchronous recording
+  recBusy[0] = recBusy[1] = false;
+  recNext = 0;
+  asyncRecord = false; // Opt in with setAsyncRecording
+  recQuit = false;
   // Velocity analysis
   vbins = 200;
   maxF = 3.25;
@@ -28,6 +70,15 @@ Simulator::Simulator() : lastDisp(0), dispTime(1./15.), dispFactor(1), time(0),
 };
 
 Simulator::~Simulator() {
+  // Stop the recording thread
+  if (recThread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(recMutex);
+      recQuit = true;
+    }
+    recCond.notify_all();
+    recThread.join();
+  }
   for (auto P : particles) 
     if (P) {
       delete P;
@@ -38,10 +89,6 @@ Simulator::~Simulator() {
       delete W;
       W = 0;
     }
-  if (sectors) {
-    delete [] sectors;
-    sectors = 0;
-  }
 }
 
 void Simulator::createSquare(int N, double radius) {
@@ -280,23 +327,30 @@ void Simulator::createBacteriaBox(int N, double radius, double width, double hei
 
 bool Simulator::wouldOverlap(vect<> pos, double R) {
   if (pos.x-R<left || right<pos.x+R || pos.y-R<bottom || top<pos.y+R) return true;
-  for (auto P : particles) {
-    if (P) {
+  if (overlapDirty) buildOverlapGrid(R);
+  // Only the particles near pos are checked, using their current positions
+  if (arraysActive)
+    return overlapGrid.search(pos, R, [&] (int i) {
+	vect<> displacement = parray.getPosition(i)-pos;
+	return displacement*displacement < sqr(R + parray.getRadius(i));
+      });
+  return overlapGrid.search(pos, R, [&] (int i) {
+      Particle *P = overlapParticles[i];
+      if (P==0) return false;
       vect<> displacement = P->getPosition()-pos;
-      double minSepSqr = sqr(R + P->getRadius());
-      if (displacement*displacement < minSepSqr) return true;
-    }
-  }
-  return false;
+      return displacement*displacement < sqr(R + P->getRadius());
+    });
 }
 
 void Simulator::run(double runLength) {
   //Reset all neccessary variables for the start of a run
+  bool resumed = resuming;
   resetVariables();
-  // Run the simulation
-  clock_t start = clock();
-  // Initial record of data
-  if (time>=startRecording && time<stopRecording || recAllIters) record();
+  if (useArrays && arraysSupported()) loadArrays();
+  // Run the simulation (wall time, since clock() adds up the time of every thread)
+  double start = omp_get_wtime();
+  // Initial record of data (a resumed run already recorded this time)
+  if (!resumed && (time>=startRecording && time<stopRecording || recAllIters)) record();
   while(time<runLength && running) { // Terminate based on internal condition
     // Gravity, flow, particle-particle, and particle-wall forces
     calculateForces();
@@ -304,26 +358,35 @@ void Simulator::run(double runLength) {
     logisticUpdates(); 
     // Update particles, sectors, and temp walls
     objectUpdates();
+    // Save the state if a checkpoint is due
+    checkpoint();
   }
-  clock_t end = clock();
-  runTime = (double)(end-start)/CLOCKS_PER_SEC;
+  if (arraysActive) storeArrays();
+  finishRecording();
+  trajectory.flush();
+  runTime = omp_get_wtime()-start;
 }
 
 void Simulator::bacteriaRun(double runLength) {
   //Reset all neccessary variables for the start of a run
+  bool resumed = resuming;
   resetVariables();
-  // Create waste, resource, and auxilary fields
-  resource.setDims(secX-2,secY-2); waste.setDims(secX-2,secY-2); buffer.setDims(secX-2,secY-2);
-  // Set field wrapping
-  resource.setWrapX(xLBound==xRBound && xRBound==WRAP); resource.setWrapY(yTBound==yBBound && yBBound==WRAP);
-  waste.setWrapX(xLBound==xRBound && xRBound==WRAP); waste.setWrapY(yTBound==yBBound && yBBound==WRAP);
-  buffer.setWrapX(xLBound==xRBound==WRAP); buffer.setWrapY(yTBound==yBBound==WRAP);
-  // Initialize the values of the waste and resource fields
-  initializeFields();
-  // Run the simulation
-  clock_t start = clock();
-  // Initial record of data
-  if (time>=startRecording && time<stopRecording || recAllIters) record();
+  // A resumed run keeps the fields from the checkpoint
+  if (!resumed) {
+    // Create waste, resource, and auxilary fields
+    resource.setDims(secX-2,secY-2); waste.setDims(secX-2,secY-2); buffer.setDims(secX-2,secY-2);
+    // Set field wrapping
+    resource.setWrapX(xLBound==xRBound && xRBound==WRAP); resource.setWrapY(yTBound==yBBound && yBBound==WRAP);
+    waste.setWrapX(xLBound==xRBound && xRBound==WRAP); waste.setWrapY(yTBound==yBBound && yBBound==WRAP);
+    buffer.setWrapX(xLBound==xRBound==WRAP); buffer.setWrapY(yTBound==yBBound==WRAP);
+    // Initialize the values of the waste and resource fields
+    initializeFields();
+  }
+  if (useArrays && arraysSupported()) loadArrays();
+  // Run the simulation (wall time, since clock() adds up the time of every thread)
+  double start = omp_get_wtime();
+  // Initial record of data (a resumed run already recorded this time)
+  if (!resumed && (time>=startRecording && time<stopRecording || recAllIters)) record();
   while(time<runLength && running) { // Terminate based on internal condition
     // Gravity, flow, particle-particle, and particle-wall forces
     calculateForces();
@@ -331,15 +394,24 @@ void Simulator::bacteriaRun(double runLength) {
     logisticUpdates();
     // Update particles, sectors, and temp walls
     objectUpdates();
-    // Bacteria eat, produce waste
-    bacteriaUpdate();
+    // Bacteria eat, produce waste (this needs the particles themselves)
+    if (arraysActive) {
+      parray.store();
+      updateSectors();
+    }
+    // Reload the arrays only if the particles changed, so the arrays keep their sector or curve order
+    if (bacteriaUpdate() && arraysActive) parray.load(particles);
     // Update fields, diffusion and advection
     updateFields();
     // If everyone dies, stop the simulation
     if (particles.empty()) running = false;
+    // Save the state if a checkpoint is due
+    checkpoint();
   }
-  clock_t end = clock();
-  runTime = (double)(end-start)/CLOCKS_PER_SEC;
+  if (arraysActive) storeArrays();
+  finishRecording();
+  trajectory.flush();
+  runTime = omp_get_wtime()-start;
 }
 
 double Simulator::getMark(int i) {
@@ -356,13 +428,83 @@ double Simulator::getMarkDiff() {
   return timeMarks.at(timeMarks.size()-1)-timeMarks.at(0);
 }
 
+double Simulator::getVerletRebuildRate() {
+  if (verletRebuilds==0) return 0;
+  return (double)iter/verletRebuilds;
+}
+
+double Simulator::getNeighborDistance() {
+  // Positions and radii in storage order: the arrays, if they are in use or the last run used them,
+  // otherwise the particle objects, ranked by address (their order in the list says nothing about
+  // where they are in memory)
+  vector<vect<> > pos;
+  vector<double> rad;
+  if (arraysActive || (useArrays && parray.size()==static_cast<int>(particles.size()) && parray.size()>0))
+    for (int i=0; i<parray.size(); i++) {
+      pos.push_back(parray.getPosition(i));
+      rad.push_back(parray.getRadius(i));
+    }
+  else {
+    vector<Particle*> listed(particles.begin(), particles.end());
+    vector<pair<size_t, int> > address(listed.size());
+    for (size_t i=0; i<listed.size(); i++) address[i] = pair<size_t, int>(reinterpret_cast<size_t>(listed[i]), i);
+    std::sort(address.begin(), address.end());
+    for (auto &A : address) {
+      pos.push_back(listed[A.second]->getPosition());
+      rad.push_back(listed[A.second]->getRadius());
+    }
+  }
+  // Sort into sectors, and look for neighbors in the surrounding sectors
+  CellList near;
+  near.setCells((secX+2)*(secY+2)+1);
+  vector<int> sec(pos.size());
+  for (size_t i=0; i<pos.size(); i++) sec[i] = getSec(pos[i]);
+  near.build(sec);
+  bool wrapX = xLBound==WRAP || xRBound==WRAP, wrapY = yBBound==WRAP || yTBound==WRAP;
+  double total = 0;
+  long pairs = 0;
+  for (int y=1; y<secY+1; y++)
+    for (int x=1; x<secX+1; x++)
+      for (int k=near.begin(y*(secX+2)+x); k<near.end(y*(secX+2)+x); k++) {
+	int p = near.at(k);
+	for (int j=y-1; j<=y+1; j++) {
+	  int sy = j;
+	  if (wrapY && j==0) sy=secY;
+	  else if (wrapY && j==secY+1) sy=1;
+	  for (int i=x-1; i<=x+1; i++) {
+	    int sx = i;
+	    if (wrapX && i==0) sx=secX;
+	    else if (wrapX && i==secX+1) sx=1;
+	    for (int l=near.begin(sy*(secX+2)+sx); l<near.end(sy*(secX+2)+sx); l++) {
+	      int q = near.at(l);
+	      // Neighbors are particles within the skin depth of touching
+	      if (p!=q && sqr(getDisplacement(pos[q], pos[p]))<sqr(rad[p]+rad[q]+skinDepth)) {
+		total += abs(p-q);
+		pairs++;
+	      }
+	    }
+	  }
+	}
+      }
+  return pairs>0 ? total/pairs : 0;
+}
+
 vector<vect<> > Simulator::getAveProfile() {
   return aveProfile();
 }
 
+double Simulator::getTimeSaved() {
+  // A fixed step costs about what one of our steps does without the stepping overhead and the extra substeps
+  if (adaptiveSteps==0) return 0;
+  return (runTime-adaptiveTime)/adaptiveSteps*fixedSteps - runTime;
+}
+
 void Simulator::addStatistic(statfunc func) {
+  finishRecording(); // The recording thread must not see the statistics change size
   statistics.push_back(func);
   statRec.push_back(vector<vect<>>());
+  statAcc.push_back(StatAccumulator());
+  fused.push_back(fusedStatistic(func));
 }
 
 vector<vect<> > Simulator::getStatistic(int i) {
@@ -371,84 +513,66 @@ vector<vect<> > Simulator::getStatistic(int i) {
 }
 
 vector<double> Simulator::getDensityXProfile() {
+  if (sectorsDirty) updateSectors();
   vector<double> profile;
   for(int x=1; x<=secX; x++) {
     int total = 0;
     for (int y=1; y<=secY; y++)
-      total += sectors[x+(secX+2)*y].size();
+      total += cells.count(x+(secX+2)*y);
     profile.push_back(total);
   }
   return profile;
 }
 
 vector<double> Simulator::getDensityYProfile() {
-  vector<double> profile(samplePoints,0);
-  double invdy = samplePoints/(top-bottom);
+  return densityYProfile(particles, samplePoints, bottom, top);
+}
+
+inline vector<double> Simulator::densityYProfile(list<Particle*>& particles, int points, double bottom, double top) {
+  vector<double> profile(points,0);
+  double invdy = points/(top-bottom);
   for (auto P : particles) {
     double y = P->getPosition().y-bottom;
     int index = (int)(y*invdy);
-    if (0<=index || index<samplePoints) profile.at(index)++;
+    if (0<=index && index<points) profile.at(index)++;
   }
   return profile;
 }
 
 double Simulator::aveVelocity() {
-  double velocity = 0;
-  int N = 0;
-  for (auto P : particles)
-    if (P && inBounds(P)) {
-      velocity += P->getVelocity().norm();
-      N++;
-    }
-  return N>0 ? velocity/N : -1.0;
+  const Observables &O = observe(OBS_VELOCITY);
+  return O.count>0 ? O.velocity/O.count : -1.0;
 }
 
 double Simulator::aveVelocitySqr() {
-  double vsqr = 0;
-  int N = 0;
-  for (auto P : particles)
-    if (P && inBounds(P)) {
-	vsqr += sqr(P->getVelocity());
-	N++;
-      }
-  return N>0 ? vsqr/N : -1.0;
+  const Observables &O = observe(OBS_VELOCITY_SQR);
+  return O.count>0 ? O.velocitySqr/O.count : -1.0;
 }
 
 double Simulator::aveKE() {
-  double KE = 0;
-  int N = 0;
-  for (auto P : particles) {
-    if (P && inBounds(P)) {
-      KE += P->getKE();
-      N++;
-    }
-  }
-  return N>0 ? KE/N : -1.0;
+  const Observables &O = observe(OBS_KE);
+  return O.count>0 ? O.KE/O.count : -1.0;
 }
 
 double Simulator::highestPosition() {
-  double y = bottom;
-  for (auto P : particles) {
-    vect<> p = P->getPosition();
-    if (p.y>y) y = p.y;
-  }
-  return y;
+  return observe(OBS_HIGHEST).highest;
 }
 
 vect<> Simulator::netMomentum() {
-  vect<> momentum;
-  for (auto P : particles) {
-    if (P && inBounds(P)) momentum += P->getMass()*P->getVelocity();
-  }
-  return momentum;
+  return observe(OBS_MOMENTUM).momentum;
 }
 
 vect<> Simulator::netVelocity() {
-  vect<> velocity;
-  for (auto P : particles) {
-    if(P && inBounds(P)) velocity += P->getVelocity();
+  return observe(OBS_NET_VELOCITY).netVelocity;
+}
+
+const Observables& Simulator::observe(unsigned which) {
+  unsigned missing = which & OBS_ALL & ~obsValid;
+  if (missing) {
+    computeObservables(missing);
+    obsValid |= missing;
   }
-  return velocity;
+  return obs;
 }
 
 void Simulator::setSectorDims(int sx, int sy) {
@@ -456,13 +580,10 @@ void Simulator::setSectorDims(int sx, int sy) {
   sy = sy<1 ? 1 : sy;
   // Create new sectors
   secX = sx; secY = sy;
-  if (sectors) delete [] sectors;
-  sectors = new list<Particle*>[(secX+2)*(secY+2)+1];
-  // Add particles to the new sectors
-  for (auto P : particles) {
-    int sec = getSec(P->getPosition());
-    sectors[sec].push_back(P);
-  }
+  cells.setCells((secX+2)*(secY+2)+1);
+  sectorsDirty = true;
+  verletDirty = true;
+  wallsDirty = true;
 }
 
 vector<vect<> > Simulator::getVelocityDistribution() {
@@ -498,23 +619,226 @@ void Simulator::setDimensions(double l, double r, double b, double t) {
   if (left>=right || bottom>=top) throw BadDimChoice();
   left = l; right = r; bottom = b; top = t;
   yTop = top;
+  wallsDirty = true;
+  overlapDirty = true;
 }
 
 void Simulator::addWall(Wall* wall) {
-  // Do fancier things?
   walls.push_back(wall);
+  wallsDirty = true;
 }
 
 void Simulator::addTempWall(Wall* wall, double duration) {
   tempWalls.push_back(pair<Wall*,double>(wall, duration));
+  wallsDirty = true;
 }
 
 void Simulator::addParticle(Particle* particle) {
   if (particle->isActive()) asize++;
   else psize++;
-  int sec = getSec(particle->getPosition());
-  sectors[sec].push_back(particle);
   particles.push_back(particle);
+  sectorsDirty = true;
+  batchesDirty = true;
+  obsValid = 0;
+  verletDirty = true;
+  if (maxReach(particle)>wallRadius) wallsDirty = true;
+  // Keep the overlap grid up to date, so placing many particles stays linear
+  if (!overlapDirty && !arraysActive) {
+    overlapGrid.insert(overlapParticles.size(), particle->getPosition(), particle->getRadius());
+    overlapParticles.push_back(particle);
+    // The grid was sized for fewer particles, rebuild it with more cells
+    if (overlapGrid.crowded()) overlapDirty = true;
+  }
+  else overlapDirty = true;
+}
+
+void Simulator::setTrajectory(string filename, bool single) {
+  finishRecording();
+  trajectory.open(filename, left, right, bottom, top, TRJ_VELOCITY | TRJ_RADIUS | (single ? TRJ_SINGLE : 0));
+}
+
+double Simulator::loadTrajectory(string filename, double t) {
+  TrajectoryReader reader;
+  reader.open(filename);
+  if (reader.getFrames()==0) throw TrajectoryReader::BadTrajectoryFile();
+  TrajectoryFrame frame = reader.getFrame(reader.seek(t));
+  if (frame.count!=static_cast<int>(watchlist.size())) throw TrajectoryReader::BadTrajectoryFile();
+  // Restore the watched particles, in the order they were recorded
+  int i = 0;
+  for (auto P : watchlist) {
+    P->getPosition() = frame.position(i);
+    if (frame.vel) P->setVelocity(frame.velocity(i));
+    if (frame.rad) P->setRadius(frame.radius(i));
+    i++;
+  }
+  sectorsDirty = verletDirty = overlapDirty = wallsDirty = true;
+  return frame.time;
+}
+
+void Simulator::closeTrajectory() {
+  finishRecording();
+  trajectory.close();
+}
+
+void Simulator::setCheckpoint(string filename, double interval) {
+  checkpointFile = filename;
+  checkpointInterval = interval;
+}
+
+void Simulator::saveCheckpoint(string filename) {
+  if (arraysActive) parray.store();
+  finishRecording();
+  // Write to a temporary file first, so a crash while saving leaves the last checkpoint intact
+  string temp = filename+".tmp";
+  std::ofstream out(temp, std::ios::binary);
+  if (!out) throw BadCheckpointFile();
+  out.write("GFLOWCHK", 8);
+  writeBinary(out, static_cast<uint32_t>(6));
+  // Boundaries and forces
+  writeBinary(out, left); writeBinary(out, right); writeBinary(out, bottom); writeBinary(out, top);
+  writeBinary(out, xLBound); writeBinary(out, xRBound); writeBinary(out, yTBound); writeBinary(out, yBBound);
+  writeBinary(out, yTop); writeBinary(out, gravity); writeBinary(out, hasDrag);
+  writeBinary(out, flowV); writeBinary(out, temperature); writeBinary(out, charRadius);
+  writeBinary(out, secX); writeBinary(out, secY);
+  // Bacteria and fields
+  writeBinary(out, resourceDiffusion); writeBinary(out, wasteDiffusion); writeBinary(out, spectralDiffusion);
+  writeBinary(out, secretionRate); writeBinary(out, eatRate);
+  writeBinary(out, replenish); writeBinary(out, wasteSource);
+  writeBinary(out, alphaR); writeBinary(out, alphaW); writeBinary(out, betaR);
+  writeBinary(out, csatR); writeBinary(out, csatW); writeBinary(out, lamR); writeBinary(out, lamW);
+  resource.save(out); waste.save(out); buffer.save(out);
+  writeBinary(out, recFields);
+  writeBinary(out, resourceStr); writeBinary(out, wasteStr); writeBinary(out, fitnessStr);
+  // Times
+  writeBinary(out, time); writeBinary(out, epsilon);
+  writeBinary(out, default_epsilon); writeBinary(out, min_epsilon); writeBinary(out, minepsilon);
+  writeBinary(out, adjust_epsilon); writeBinary(out, dispTime); writeBinary(out, dispFactor);
+  writeBinary(out, adaptive); writeBinary(out, maxSubsteps); writeBinary(out, max_epsilon); writeBinary(out, stepTolerance);
+  writeBinary(out, integrator.getType()); writeBinary(out, integrator.getFriction());
+  writeBinary(out, lastDisp); writeBinary(out, iter); writeBinary(out, recIt); writeBinary(out, maxIters);
+  // Objects, tagged with their type
+  writeBinary(out, static_cast<uint64_t>(particles.size()));
+  for (auto P : particles) {
+    writeBinary(out, P->getType());
+    P->save(out);
+  }
+  vector<int> watched; // Positions of the watched particles in the particle list
+  for (auto W : watchlist) watched.push_back(std::distance(particles.begin(), std::find(particles.begin(), particles.end(), W)));
+  writeBinary(out, watched);
+  writeBinary(out, static_cast<uint64_t>(walls.size()));
+  for (auto W : walls) W->save(out);
+  writeBinary(out, static_cast<uint64_t>(tempWalls.size()));
+  for (auto W : tempWalls) {
+    W.first->save(out);
+    writeBinary(out, W.second);
+  }
+  // Records
+  writeBinary(out, watchPos); writeBinary(out, statRec); writeBinary(out, recAllIters);
+  writeBinary(out, static_cast<uint64_t>(statAcc.size()));
+  for (auto &A : statAcc) A.save(out);
+  writeBinary(out, velocityDistribution); writeBinary(out, auxVelocityDistribution);
+  writeBinary(out, maxV); writeBinary(out, maxF); writeBinary(out, vbins);
+  writeBinary(out, timeMarks); writeBinary(out, lastMark); writeBinary(out, markWatch);
+  writeBinary(out, startRecording); writeBinary(out, stopRecording);
+  writeBinary(out, startTime); writeBinary(out, delayTime); writeBinary(out, delayTriggeredExit);
+  writeBinary(out, samplePoints); writeBinary(out, profiles);
+  // Random numbers (each particle saved its own stream)
+  writeBinary(out, randomSeed().load()); writeBinary(out, globalRandom()); writeBinary(out, Particle::peekId());
+  out.close();
+  if (!out || std::rename(temp.c_str(), filename.c_str())!=0) throw BadCheckpointFile();
+}
+
+void Simulator::loadCheckpoint(string filename) {
+  std::ifstream in(filename, std::ios::binary);
+  char magic[8];
+  uint32_t version;
+  if (!in || !in.read(magic, 8) || string(magic, 8)!="GFLOWCHK") throw BadCheckpointFile();
+  readBinary(in, version);
+  if (version!=6) throw BadCheckpointFile();
+  finishRecording();
+  discard();
+  // Boundaries and forces
+  readBinary(in, left); readBinary(in, right); readBinary(in, bottom); readBinary(in, top);
+  readBinary(in, xLBound); readBinary(in, xRBound); readBinary(in, yTBound); readBinary(in, yBBound);
+  readBinary(in, yTop); readBinary(in, gravity); readBinary(in, hasDrag);
+  readBinary(in, flowV); readBinary(in, temperature); readBinary(in, charRadius);
+  readBinary(in, secX); readBinary(in, secY);
+  setSectorDims(secX, secY);
+  // Bacteria and fields
+  readBinary(in, resourceDiffusion); readBinary(in, wasteDiffusion); readBinary(in, spectralDiffusion);
+  readBinary(in, secretionRate); readBinary(in, eatRate);
+  readBinary(in, replenish); readBinary(in, wasteSource);
+  readBinary(in, alphaR); readBinary(in, alphaW); readBinary(in, betaR);
+  readBinary(in, csatR); readBinary(in, csatW); readBinary(in, lamR); readBinary(in, lamW);
+  resource.load(in); waste.load(in); buffer.load(in);
+  readBinary(in, recFields);
+  readBinary(in, resourceStr); readBinary(in, wasteStr); readBinary(in, fitnessStr);
+  // Times
+  readBinary(in, time); readBinary(in, epsilon);
+  readBinary(in, default_epsilon); readBinary(in, min_epsilon); readBinary(in, minepsilon);
+  readBinary(in, adjust_epsilon); readBinary(in, dispTime); readBinary(in, dispFactor);
+  readBinary(in, adaptive); readBinary(in, maxSubsteps); readBinary(in, max_epsilon); readBinary(in, stepTolerance);
+  IntegratorType type;
+  double friction;
+  readBinary(in, type); readBinary(in, friction);
+  integrator.setType(type); integrator.setFriction(friction);
+  readBinary(in, lastDisp); readBinary(in, iter); readBinary(in, recIt); readBinary(in, maxIters);
+  // Objects
+  uint64_t count;
+  readBinary(in, count);
+  vector<Particle*> loaded;
+  for (uint64_t i=0; i<count; i++) {
+    PType type;
+    readBinary(in, type);
+    Particle *P = 0;
+    switch (type) {
+    case PASSIVE: P = new Particle(Zero, 0); break;
+    case RTSPHERE: P = new RTSphere(Zero, 0); break;
+    case BACTERIA: P = new Bacteria(Zero, 0); break;
+    default: throw BadCheckpointFile();
+    }
+    P->load(in);
+    addParticle(P);
+    loaded.push_back(P);
+  }
+  vector<int> watched;
+  readBinary(in, watched);
+  for (auto i : watched) watchlist.push_back(loaded.at(i));
+  readBinary(in, count);
+  for (uint64_t i=0; i<count; i++) {
+    Wall *W = new Wall(Zero, E0);
+    W->load(in);
+    addWall(W);
+  }
+  readBinary(in, count);
+  for (uint64_t i=0; i<count; i++) {
+    Wall *W = new Wall(Zero, E0);
+    double until;
+    W->load(in);
+    readBinary(in, until);
+    addTempWall(W, until);
+  }
+  // Records (the statistic functions themselves are whatever this simulator was given)
+  readBinary(in, watchPos); readBinary(in, statRec); readBinary(in, recAllIters);
+  statRec.resize(statistics.size());
+  readBinary(in, count);
+  for (uint64_t i=0; i<count; i++) {
+    StatAccumulator A;
+    A.load(in);
+    if (i<statAcc.size()) statAcc[i] = A;
+  }
+  readBinary(in, velocityDistribution); readBinary(in, auxVelocityDistribution);
+  readBinary(in, maxV); readBinary(in, maxF); readBinary(in, vbins);
+  readBinary(in, timeMarks); readBinary(in, lastMark); readBinary(in, markWatch);
+  readBinary(in, startRecording); readBinary(in, stopRecording);
+  readBinary(in, startTime); readBinary(in, delayTime); readBinary(in, delayTriggeredExit);
+  readBinary(in, samplePoints); readBinary(in, profiles);
+  // Random numbers, last since creating the particles above used ids and draws
+  uint64_t seed, id;
+  readBinary(in, seed); readBinary(in, globalRandom()); readBinary(in, id);
+  randomSeed() = seed;
+  Particle::reserveIds(id);
+  resuming = true;
 }
 
 void Simulator::addWatchedParticle(Particle* p) {
@@ -523,55 +847,12 @@ void Simulator::addWatchedParticle(Particle* p) {
 }
 
 vector<vect<> > Simulator::findPackedSolution(int N, double R, double left, double right, double bottom, double top) {
-  vector<Particle*> parts;
-  vector<Wall*> bounds;
-  bounds.push_back(new Wall(vect<>(left,bottom), vect<>(left,top)));
-  bounds.push_back(new Wall(vect<>(left,top), vect<>(right,top)));
-  bounds.push_back(new Wall(vect<>(right,top), vect<>(right,bottom)));
-  bounds.push_back(new Wall(vect<>(right,bottom), vect<>(left,bottom)));
-  
-  // Add particles in with small radii
-  double l = left + 0.05*R, x = right - 0.05*R - l;
-  double b = bottom + 0.05*R, y = top - 0.05*R - b;
-  for (int i=0; i<N; i++) {
-    vect<> pos = vect<>(b+x*drand48(), b+y*drand48());
-    //addParticle(new Particle(pos, 0.05*R));
-    parts.push_back(new Particle(pos, 0.05*R));
-  }
-
-  // Enlarge particles and thermally agitate
-  int steps = 2500;
-  double dr = (R-0.05*R)/(double)steps, radius = 0.05*R;;
-  double mag = 5, dm = mag/(double)steps;
-  for (int i=0; i<steps; i++) {
-    // Particle - particle interactions
-    //ppInteract();
-    
-    for (auto P : parts)
-      for (auto Q : parts)
-        if (P!=Q) P->interact(Q);
-
-    // Thermal agitation
-    mag -= dm;
-    for (auto P: parts) P->applyForce(mag*randV());
-    // Boundary walls
-    for (auto W : bounds)
-      for (auto P : parts)
-	W->interact(P);
-    // Other walls (so we don't put particles inside of walls)
-    for (auto W : walls)
-      for (auto P : parts)
-        W->interact(P);
-    // Adjust radius
-    radius += dr;
-    for (auto &P : parts) P->setRadius(radius);
-    for (auto &P : parts) update(P);
-  }
-
-  // Return list of positions
-  vector<vect<> > pos;
-  for (auto P : parts) pos.push_back(P->getPosition());
-  //particles.clear();
+  Packer packer(left, right, bottom, top);
+  // Don't put particles inside of walls
+  for (auto W : walls) packer.addWall(W);
+  vector<vect<> > pos = packer.pack(N, R);
+  packPhi = packer.getPhi();
+  packOverlap = packer.getMaxOverlap();
   return pos;
 }
 
@@ -628,6 +909,10 @@ string Simulator::printWaste() {
 }
 
 string Simulator::printFitness() {
+  return printFitness(resource, waste, secX, secY);
+}
+
+inline string Simulator::printFitness(Field& resource, Field& waste, int secX, int secY) {
   if (resource.getDX()==0 || resource.getDY()==0 || waste.getDX()==0 || waste.getDY()==0) return "";
   stringstream stream;
   string str;
@@ -635,7 +920,8 @@ string Simulator::printFitness() {
   for (int y=1; y<secY-1; y++) {
     stream << '{';
     for (int x=1; x<secX-1; x++) {
-      stream << getFitness(x,y);
+      double res = resource.at(x-1,y-1), wst = waste.at(x-1,y-1);
+      stream << res/(res+1) - wst/(wst+1);
       if (x!=secX-2) stream << ',';
     }
     stream << '}';
@@ -701,16 +987,28 @@ void Simulator::setParticleFix(bool f) {
 }
 
 inline void Simulator::resetVariables() {
-  recIt = 0;
-  time = 0;
-  lastMark = startTime;
-  iter = 0;
-  delayTriggeredExit = false;
-  lastDisp = -1e9;
-  minepsilon = default_epsilon;
+  // Continuing from a checkpoint keeps the clock and the records
+  if (!resuming) {
+    recIt = 0;
+    time = 0;
+    lastMark = startTime;
+    iter = 0;
+    delayTriggeredExit = false;
+    lastDisp = -1e9;
+    minepsilon = default_epsilon;
+    epsilon = default_epsilon;
+    resetStatistics();
+  }
+  resuming = false;
   runTime=0;
+  adaptiveTime = fixedSteps = 0;
+  adaptiveSteps = 0;
+  lastAccel.clear();
   running = true;
-  resetStatistics();
+  verletRebuilds = 0;
+  reorders = 0;
+  lastCheckpoint = time;
+  integrator.setTemperature(temperature);
 }
 
 inline void Simulator::initializeFields() {
@@ -729,6 +1027,11 @@ inline void Simulator::initializeFields() {
 }
 
 inline void Simulator::calculateForces() {
+  obsValid = 0; // A new step
+  if (arraysActive) {
+    arrayForces();
+    return;
+  }
   // Gravity
   if (gravity!=Zero)
     for (auto P : particles) P->applyForce(P->getMass()*gravity);
@@ -739,15 +1042,20 @@ inline void Simulator::calculateForces() {
   }
   // Calculate particle-particle and particle-wall forces
   interactions();
-  // Temperature causes brownian motion
-  if (temperature>0) {
-    for (auto P : particles) P->applyForce(temperature*randV());
+  // Temperature causes brownian motion (the BAOAB integrator applies it itself)
+  if (temperature>0 && integrator.getType()!=BAOAB) {
+    for (auto P : particles) P->applyForce(temperature*randV(P->getRandom()));
   }
 }
 
 inline void Simulator::logisticUpdates() {
   // Calculate appropriate epsilon
-  if (adjust_epsilon) {
+  if (adaptive) {
+    epsilon = adaptiveStep();
+    if (epsilon<minepsilon) minepsilon = epsilon;
+  }
+  else if (adjust_epsilon) {
+    observe(OBS_MAX_VELOCITY|OBS_MAX_ACCELERATION); // One pass for both
     double vmax = fabs(maxVelocity());
     double amax = maxAcceleration();
     double M = max(amax, vmax);
@@ -776,25 +1084,45 @@ inline void Simulator::logisticUpdates() {
 }
 
 inline void Simulator::objectUpdates() {
+  // Keep particles that are close in space close in memory
+  if (arraysActive && reorderInterval>0 && iter%reorderInterval==0) reorderParticles();
+  // Particles are about to move, so the overlap grid will need to be rebuilt if it is used
+  overlapDirty = true;
+  obsValid = 0;
   // Update simulation
-  for (auto &P : particles) update(P); // Update particles
-  if (sectorize) updateSectors(); // Update sectors
+  if (arraysActive) arrayUpdates();
+  else {
+    if (adaptive && substeps>1) substepUpdates();
+    else if (randomBounds()) // Reinserted particles check for overlaps, so keep the list order
+      for (auto &P : particles) update(P, epsilon);
+    else { // Update particles, one batch of each type
+      if (batchesDirty) buildBatches();
+      update(passiveBatch, epsilon);
+      update(rtBatch, epsilon);
+      update(bacteriaBatch, epsilon);
+    }
+    if (sectorize) updateSectors(); // Update sectors
+  }
   // Update temp walls
   if (!tempWalls.empty()) {
     vector<list<pair<Wall*,double> >::iterator> removal;
     for (auto w=tempWalls.begin(); w!=tempWalls.end(); ++w)
       if (w->second<time) removal.push_back(w);
     for (auto w : removal) tempWalls.erase(w);
+    if (!removal.empty()) wallsDirty = true;
   }
 }
 
-inline void Simulator::bacteriaUpdate() {
+inline bool Simulator::bacteriaUpdate() {
   // Assume that all particles are bacteria
   vector<Particle*> births; // Record bacteria to add and take away
+  bool deaths = false;
+  obsValid = 0;
+  if (sectorsDirty) updateSectors();
   for (int y=1; y<secY-1; y++) 
     for (int x=1; x<secX-1; x++) {
-      list<Particle*>& sect = sectors[(secX+2)*y + x+1];
-      int number = sect.size();
+      int sec = (secX+2)*y + x+1;
+      int number = cells.count(sec);
       if (number>0) {
 	// Update waste and resource fields
 	double &res = resource.at(x-1,y-1), &wst = waste.at(x-1,y-1);
@@ -812,27 +1140,32 @@ inline void Simulator::bacteriaUpdate() {
 	double fitness = alpha1*res/(res+csat1)-alpha2*wst/(wst+csat2)-beta1*secretionRate;
 	// Die if neccessary
 	if (fitness<0) {
-	  for (auto p=sect.begin(); p!=sect.end(); ++p) {
-	    particles.remove(*p);
-	    watchlist.remove(*p);
-	    delete *p;
-	    *p=0;
+	  for (int k=cells.begin(sec); k<cells.end(sec); k++) {
+	    particles.remove(sectors[k]);
+	    watchlist.remove(sectors[k]);
+	    delete sectors[k];
+	    sectors[k]=0;
+	    deaths = true;
 	  }
-	  sect.clear();
+	  sectorsDirty = true;
+	  batchesDirty = true;
+	  verletDirty = true;
+	  overlapDirty = true;
 	}
 	// Reproduce if able
 	else
-	  for (auto P : sectors[(secX+2)*y + x+1]) {
-	    Bacteria* b = dynamic_cast<Bacteria*>(P);
+	  for (int k=cells.begin(sec); k<cells.end(sec); k++) {
+	    if (sectors[k]->getType()!=BACTERIA) continue;
+	    Bacteria* b = static_cast<Bacteria*>(sectors[k]);
 	    if (b->canReproduce()) {
 	      double rd = b->getRepDelay();
-	      double attempt = drand48();	  
+	      double attempt = b->getRandom().next();
 	      if (attempt<fitness*rd) {
 		int tries = 50; // Try to find a good spot for the baby
 		vect<> pos = b->getPosition();
 		double rad = b->getMaxRadius();
 		for (int i=0; i<tries; i++) {
-		  vect<> s = 2.1*rad*randV() + pos;
+		  vect<> s = 2.1*rad*randV(b->getRandom()) + pos;
 		  if (!wouldOverlap(s, rad)) {
 		    Bacteria *B = new Bacteria(s, rad, 0); // No expansion time
 		    B->setVelocity(b->getVelocity());
@@ -847,9 +1180,26 @@ inline void Simulator::bacteriaUpdate() {
       }
     }
   for (auto P : births) addWatchedParticle(P);
+  return deaths || !births.empty();
 }
 
 inline void Simulator::updateFields() {
+  if (spectralDiffusion) {
+    // Sources first, then a backward Euler diffusion step
+    for (int y=0; y<resource.getDY(); y++)
+      for (int x=0; x<resource.getDX(); x++) {
+        resource.at(x,y) += epsilon*replenish;
+        waste.at(x,y) += epsilon*wasteSource;
+      }
+    resource.implicitDiffusion(resourceDiffusion, epsilon);
+    waste.implicitDiffusion(wasteDiffusion, epsilon);
+    for (int y=0; y<resource.getDY(); y++)
+      for (int x=0; x<resource.getDX(); x++) {
+        resource.at(x,y) = resource.at(x,y)<0 ? 0 : resource.at(x,y);
+        waste.at(x,y) = waste.at(x,y)<0 ? 0 : waste.at(x,y);
+      }
+    return;
+  }
   // Diffusion of resource field
   delSqr(resource, buffer); 
   for (int y=0; y<resource.getDY(); y++)
@@ -868,25 +1218,240 @@ inline void Simulator::updateFields() {
 }
 
 inline double Simulator::maxVelocity() {
-  double maxVsqr = -1.0;
-  for (auto P : particles) {
-    if (P && inBounds(P)) {
-      double Vsqr = P->getVelocity().normSqr();
-      if (Vsqr > maxVsqr) maxVsqr = Vsqr;
-    }
-  }
+  double maxVsqr = observe(OBS_MAX_VELOCITY).maxVsqr;
   return maxVsqr>0 ? sqrt(maxVsqr) : -1.0;
 }
 
 inline double Simulator::maxAcceleration() {
-  double maxAsqr = -1.0;
+  double maxAsqr = observe(OBS_MAX_ACCELERATION).maxAsqr;
+  return maxAsqr>0 ? sqrt(maxAsqr) : -1.0;
+}
+
+inline void Simulator::computeObservables(unsigned which) {
+  bool sums = which & (OBS_VELOCITY|OBS_VELOCITY_SQR|OBS_KE|OBS_MOMENTUM|OBS_NET_VELOCITY);
+  bool bounded = sums || which & (OBS_MAX_VELOCITY|OBS_MAX_ACCELERATION);
+  int count = 0;
+  double vel = 0, vsqr = 0, KE = 0, mx = 0, my = 0, vx = 0, vy = 0;
+  double maxVsqr = -1.0, maxAsqr = -1.0, highest = bottom;
+  if (arraysActive) {
+    int N = parray.size();
+#pragma omp parallel for num_threads(nThreads) schedule(static) reduction(+:count,vel,vsqr,KE,mx,my,vx,vy) reduction(max:maxVsqr,maxAsqr,highest)
+    for (int i=0; i<N; i++) {
+      vect<> pos = parray.getPosition(i);
+      if (pos.y>highest) highest = pos.y;
+      if (!bounded || !inBounds(pos, parray.getRadius(i))) continue;
+      vect<> v = parray.getVelocity(i);
+      double v2 = v.normSqr();
+      count++;
+      if (which & OBS_VELOCITY) vel += sqrt(v2);
+      vsqr += v2;
+      if (which & OBS_KE) KE += parray.getKE(i);
+      if (which & OBS_MOMENTUM) {
+	double m = parray.getMass(i);
+	mx += m*v.x; my += m*v.y;
+      }
+      vx += v.x; vy += v.y;
+      if (v2>maxVsqr) maxVsqr = v2;
+      if (which & OBS_MAX_ACCELERATION) maxAsqr = max(maxAsqr, parray.getAcceleration(i).normSqr());
+    }
+  }
+  else
+    for (auto P : particles) {
+      if (P==0) continue;
+      vect<> pos = P->getPosition();
+      if (pos.y>highest) highest = pos.y;
+      if (!bounded || !inBounds(pos, P->getRadius())) continue;
+      vect<> v = P->getVelocity();
+      double v2 = v.normSqr();
+      count++;
+      if (which & OBS_VELOCITY) vel += sqrt(v2);
+      vsqr += v2;
+      if (which & OBS_KE) KE += P->getKE();
+      if (which & OBS_MOMENTUM) {
+	double m = P->getMass();
+	mx += m*v.x; my += m*v.y;
+      }
+      vx += v.x; vy += v.y;
+      if (v2>maxVsqr) maxVsqr = v2;
+      if (which & OBS_MAX_ACCELERATION) maxAsqr = max(maxAsqr, P->getAcceleration().normSqr());
+    }
+  // Only overwrite what was asked for
+  if (sums) obs.count = count;
+  if (which & OBS_VELOCITY) obs.velocity = vel;
+  if (which & OBS_VELOCITY_SQR) obs.velocitySqr = vsqr;
+  if (which & OBS_KE) obs.KE = KE;
+  if (which & OBS_MOMENTUM) obs.momentum = vect<>(mx, my);
+  if (which & OBS_NET_VELOCITY) obs.netVelocity = vect<>(vx, vy);
+  if (which & OBS_MAX_VELOCITY) obs.maxVsqr = maxVsqr;
+  if (which & OBS_MAX_ACCELERATION) obs.maxAsqr = maxAsqr;
+  if (which & OBS_HIGHEST) obs.highest = highest;
+}
+
+inline double Simulator::adaptiveStep() {
+  double start = omp_get_wtime();
+  if (sectorize && sectorsDirty) updateSectors();
+  if (sectorize) plist = sectors;
+  else plist.assign(particles.begin(), particles.end());
+  // The position update takes the acceleration to be constant over the step, so the error of the
+  // last step is about h^2/2 |a(t+eps)-a(t)|, with h the step or substep the particle took. Contact
+  // forces are included, over a substep they change by about 1/substeps of what they did over the step
+  std::unordered_map<uint64_t, pair<vect<>, int> > accel;
+  accel.reserve(particles.size());
+  double maxError = 0, maxV = 0, maxA = 0, maxR = 0;
   for (auto P : particles) {
-    if (P && inBounds(P)) {
-      double Asqr = P->getAcceleration().normSqr();
-      if (Asqr > maxAsqr) maxAsqr = Asqr;
+    maxR = max(maxR, P->getRadius());
+    vect<> A = (1.0/P->getMass())*(P->getForce()+P->getNormalForce()+P->getShearForce());
+    if (!P->isFixed()) {
+      auto last = lastAccel.find(P->getId());
+      if (last!=lastAccel.end()) {
+	double h = epsilon/last->second.second;
+	maxError = max(maxError, 0.5*sqr(h)*sqrt(sqr(A-last->second.first))/last->second.second);
+      }
+      maxA = max(maxA, sqr(A));
+      maxV = max(maxV, sqr(P->getVelocity()));
     }
+    accel[P->getId()] = pair<vect<>, int>(A, 1);
   }
-  return maxAsqr>0 ? sqrt(maxAsqr) : -1.0;
+  lastAccel.swap(accel);
+  maxA = sqrt(maxA); maxV = sqrt(maxV);
+  double step = epsilon*(maxError>0 ? min(2., max(0.5, 0.9*sqrt(stepTolerance/maxError))) : 2.);
+  step = max(min_epsilon, min(step, max_epsilon));
+  // How close two particles could get over the step (with room for the acceleration to grow). Pairs
+  // that could meet are looked for span sectors out, the step is shortened if that would be more than two
+  auto reach = [&] (double e) { return 2*(maxV*e + maxA*sqr(e)); };
+  int span = 1;
+  if (sectorize) {
+    double width = min((right-left)/secX, (top-bottom)/secY);
+    auto sectorSpan = [&] (double e) { return max(1, static_cast<int>(ceil((2*maxR+reach(e))/width))); };
+    while (sectorSpan(step)>2 && step>min_epsilon) step = max(min_epsilon, 0.5*step);
+    span = sectorSpan(step);
+  }
+  findStiff(reach(step), span);
+  // Substeps short enough for the stiffest contact
+  substeps = 1;
+  if (!stiffList.empty()) {
+    step = max(min_epsilon, min(step, maxSubsteps*stableEpsilon));
+    substeps = max(1, min(maxSubsteps, static_cast<int>(ceil(step/stableEpsilon-1e-9))));
+  }
+  adaptiveSteps++;
+  fixedSteps += step/default_epsilon;
+  adaptiveTime += omp_get_wtime()-start;
+  return step;
+}
+
+inline void Simulator::findStiff(double reach, int span) {
+  int N = plist.size();
+  stiff.assign(N, 0);
+  stiffList.clear();
+  stiffPairs.clear();
+  stiffWalls.clear();
+  stableEpsilon = max_epsilon;
+  auto near = [&] (int p, int q) {
+    Particle *P = plist[p], *Q = plist[q];
+    double cutoff = P->getRadius()+Q->getRadius();
+    if (sqr(getDisplacement(Q->getPosition(), P->getPosition())) < sqr(cutoff+reach)) {
+      stiffPairs.push_back(pair<int,int>(p, q));
+      stiff[p] = stiff[q] = 1;
+      // The contact force is -repulsion*overlap, overlap = 1-dist/cutoff
+      double m = P->getMass()*Q->getMass()/(P->getMass()+Q->getMass());
+      stableEpsilon = min(stableEpsilon, stableStep(P->getRepulsion()/cutoff, P->getDissipation(), m));
+    }
+  };
+  if (sectorize) {
+    bool wrapX = xLBound==WRAP || xRBound==WRAP, wrapY = yBBound==WRAP || yTBound==WRAP;
+    int ssec = (secX+2)*(secY+2);
+    vector<int> nbr;
+    if (useHalfStencil() && span==1) // The same sectors as ppHalfRow
+      for (int y=1; y<secY+1; y++) {
+	int sy = wrapY && y==secY ? 1 : y+1;
+	for (int x=1; x<secX+1; x++) {
+	  int xl = wrapX && x==1 ? secX : x-1, xr = wrapX && x==secX ? 1 : x+1;
+	  int half[4] = {y*(secX+2)+xr, sy*(secX+2)+xl, sy*(secX+2)+x, sy*(secX+2)+xr};
+	  int sec = y*(secX+2)+x;
+	  for (int k=cells.begin(sec); k<cells.end(sec); k++) {
+	    for (int l=k+1; l<cells.end(sec); l++) near(k, l);
+	    for (int n=0; n<4; n++)
+	      for (int l=cells.begin(half[n]); l<cells.end(half[n]); l++) near(k, l);
+	  }
+	}
+      }
+    else
+    for (int y=0; y<secY+2; y++)
+      for (int x=0; x<secX+2; x++) {
+	int sec = y*(secX+2)+x;
+	if (cells.count(sec)==0) continue;
+	// Sectors up to span away, each once even if wrapping makes some of them the same
+	nbr.clear();
+	for (int j=y-span; j<=y+span; j++)
+	  for (int i=x-span; i<=x+span; i++) {
+	    int sx = i, sy = j;
+	    if (wrapX && (i<1 || i>secX)) sx = ((i-1)%secX+secX)%secX+1;
+	    if (wrapY && (j<1 || j>secY)) sy = ((j-1)%secY+secY)%secY+1;
+	    if (sx<0 || sx>secX+1 || sy<0 || sy>secY+1) continue;
+	    int s = sy*(secX+2)+sx;
+	    if (std::find(nbr.begin(), nbr.end(), s)==nbr.end()) nbr.push_back(s);
+	  }
+	// Each pair is found from its first particle
+	for (int k=cells.begin(sec); k<cells.end(sec); k++)
+	  for (auto b : nbr)
+	    for (int l=max(cells.begin(b), k+1); l<cells.end(b); l++) near(k, l);
+      }
+    // Out of bounds particles could be anywhere
+    for (int k=cells.begin(ssec); k<cells.end(ssec); k++)
+      for (int l=0; l<N; l++)
+	if (l!=k && (l<cells.begin(ssec) || l>k)) near(k, l);
+  }
+  else
+    for (int p=0; p<N; p++)
+      for (int q=p+1; q<N; q++) near(p, q);
+  // Walls (a particle covers half the reach, the other half was for its partner)
+  vector<Wall*> wlist(walls.begin(), walls.end());
+  for (auto W : tempWalls) wlist.push_back(W.first);
+  for (int p=0; p<N; p++)
+    for (auto W : wlist)
+      if (W->getDistance(plist[p]->getPosition()) < plist[p]->getRadius()+0.5*reach) {
+	stiffWalls.push_back(pair<Wall*,int>(W, p));
+	stiff[p] = 1;
+	stableEpsilon = min(stableEpsilon, stableStep(W->getRepulsion()/plist[p]->getRadius(), W->getDissipation(), plist[p]->getMass()));
+      }
+  for (int p=0; p<N; p++)
+    if (stiff[p]) stiffList.push_back(p);
+}
+
+inline double Simulator::stableStep(double k, double c, double m) {
+  // The particles step x += eps (v + eps a/2), v += eps a. For m x'' = -k x - c x' that is stable for
+  // eps < 2c/k and eps < 2m/c. Lightly damped contacts (the dissipation only acts while they close)
+  // can't meet the first, so for them the energy they gain is kept small instead, eps w < 0.01
+  if (k<=0) return c>0 ? 0.75*2*m/c : max_epsilon;
+  double w = sqrt(k/m);
+  double limit = max(0.75*2*c/k, 0.01/w);
+  return c>0 ? min(limit, 0.75*2*m/c) : limit;
+}
+
+inline void Simulator::substepUpdates() {
+  double dt = epsilon/substeps;
+  // Particles that can't touch anything take the whole step
+  for (size_t p=0; p<plist.size(); p++)
+    if (!stiff[p]) update(plist[p], epsilon);
+  // The first substep uses the forces found for the step
+  slowForce.resize(stiffList.size());
+  for (size_t i=0; i<stiffList.size(); i++) slowForce[i] = plist[stiffList[i]]->getForce();
+  double start = omp_get_wtime();
+  for (int s=0; s<substeps; s++) {
+    if (s>0) {
+      for (size_t i=0; i<stiffList.size(); i++) plist[stiffList[i]]->applyForce(slowForce[i]);
+      for (auto c : stiffPairs) {
+	Particle *P = plist[c.first], *Q = plist[c.second];
+	P->pairInteract(Q, getDisplacement(Q->getPosition(), P->getPosition()));
+      }
+      for (auto c : stiffWalls) c.first->contact(plist[c.second]);
+    }
+    for (auto p : stiffList) update(plist[p], dt);
+    if (s==0) start = omp_get_wtime(); // The first substep is what a fixed step would do
+  }
+  // The error estimate needs to know which particles took substeps
+  for (auto p : stiffList) lastAccel[plist[p]->getId()].second = substeps;
+  adaptiveTime += omp_get_wtime()-start;
 }
 
 inline vect<> Simulator::getDisplacement(vect<> A, vect<> B) {
@@ -919,27 +1484,186 @@ inline double Simulator::getFitness(int x, int y) {
 
 inline void Simulator::interactions() {
   // Calculate particle-particle forces
-  if (sectorize) ppInteract();
+  if (verlet) verletInteract();
+  else if (sectorize) ppInteract();
+  else if (pairHalving) // Naive solution, visiting each pair once
+    for (auto p=particles.begin(); p!=particles.end(); ++p) {
+      auto q = p;
+      for (++q; q!=particles.end(); ++q)
+	(*p)->pairInteract(*q, (*q)->getPosition()-(*p)->getPosition());
+    }
   else // Naive solution
     for (auto P : particles) 
       for (auto Q : particles)
 	if (P!=Q) P->interact(Q);
   
   // Calculate particle-wall forces
-  for (auto W : walls)
-    for (auto P : particles)
-      W->interact(P);
-  for (auto W : tempWalls) 
-    for (auto P : particles)
-      W.first->interact(P);
+  wallInteract();
 }
 
-inline void Simulator::update(Particle* &P) {
+inline void Simulator::wallInteract() {
+  if (walls.empty() && tempWalls.empty()) return;
+  if (sectorize) {
+    if (sectorsDirty) updateSectors();
+    wallSectorInteract();
+    return;
+  }
+  if (nThreads==1) {
+    for (auto W : walls)
+      for (auto P : particles)
+	W->interact(P);
+    for (auto W : tempWalls) 
+      for (auto P : particles)
+	W.first->interact(P);
+    return;
+  }
+  // Each thread handles a fixed block of particles and keeps its own wall pressures, which are
+  // summed in thread order afterwards, so the result only depends on the number of threads
+  vector<Particle*> plist(particles.begin(), particles.end());
+  vector<Wall*> wlist(walls.begin(), walls.end());
+  for (auto W : tempWalls) wlist.push_back(W.first);
+  int nw = wlist.size(), np = plist.size();
+  vector<double> pressure(nThreads*nw, 0);
+#pragma omp parallel num_threads(nThreads)
+  {
+    double *press = &pressure[omp_get_thread_num()*nw];
+#pragma omp for schedule(static)
+    for (int i=0; i<np; i++)
+      for (int w=0; w<nw; w++)
+	press[w] += wlist[w]->contact(plist[i]);
+  }
+  for (int t=0; t<nThreads; t++)
+    for (int w=0; w<nw; w++) wlist[w]->addPressure(pressure[t*nw+w]);
+}
+
+inline void Simulator::wallSectorInteract() {
+  if (wallsDirty) buildWallIndex();
+  // Sectors are handled in parallel, each thread keeping its own wall pressures like wallInteract
+  int nw = wallList.size(), ssec = (secX+2)*(secY+2);
+  wallPressure.assign(nThreads*nw, 0);
+  if (nThreads==1)
+    for (int s=0; s<ssec; s++)
+      for (int m=wallSectors.begin(s); m<wallSectors.end(s); m++) {
+	int w = wallOf[wallSectors.at(m)];
+	for (int k=cells.begin(s); k<cells.end(s); k++) wallPressure[w] += wallContact(w, k);
+      }
+  else
+#pragma omp parallel num_threads(nThreads)
+  {
+    double *press = &wallPressure[omp_get_thread_num()*nw];
+#pragma omp for schedule(static)
+    for (int s=0; s<ssec; s++)
+      for (int m=wallSectors.begin(s); m<wallSectors.end(s); m++) {
+	int w = wallOf[wallSectors.at(m)];
+	for (int k=cells.begin(s); k<cells.end(s); k++) press[w] += wallContact(w, k);
+      }
+  }
+  // Particles in the special sector could be anywhere, so they check every wall
+  for (int k=cells.begin(ssec); k<cells.end(ssec); k++)
+    for (int w=0; w<nw; w++) wallPressure[w] += wallContact(w, k);
+  for (int t=0; t<nThreads; t++)
+    for (int w=0; w<nw; w++) wallList[w]->addPressure(wallPressure[t*nw+w]);
+}
+
+inline double Simulator::wallContact(int w, int k) {
+  if (arraysActive) return parray.wallInteract(wallList[w], cells.at(k));
+  return wallList[w]->contact(sectors[k]);
+}
+
+inline void Simulator::buildWallIndex() {
+  wallList.assign(walls.begin(), walls.end());
+  for (auto W : tempWalls) wallList.push_back(W.first);
+  wallRadius = 0;
+  for (auto P : particles) wallRadius = max(wallRadius, maxReach(P));
+  // A particle touching the wall has its center in a sector whose center is within this distance of the wall
+  double sw = (right-left)/secX, sh = (top-bottom)/secY;
+  double reach = wallRadius + 0.5*sqrt(sw*sw+sh*sh);
+  wallOf.clear();
+  wallCellOf.clear();
+  for (size_t w=0; w<wallList.size(); w++) {
+    vect<> a = wallList[w]->getPosition(), b = wallList[w]->getEnd(), ab = b-a;
+    double lsqr = sqr(ab);
+    // Bounding box of the wall grown by the radius, in sectors (including the buffer sectors)
+    int x0 = max(0, static_cast<int>(floor((min(a.x,b.x)-wallRadius-left)/sw))+1);
+    int x1 = min(secX+1, static_cast<int>(floor((max(a.x,b.x)+wallRadius-left)/sw))+1);
+    int y0 = max(0, static_cast<int>(floor((min(a.y,b.y)-wallRadius-bottom)/sh))+1);
+    int y1 = min(secY+1, static_cast<int>(floor((max(a.y,b.y)+wallRadius-bottom)/sh))+1);
+    for (int y=y0; y<=y1; y++)
+      for (int x=x0; x<=x1; x++) {
+	// Distance from the center of the sector to the wall
+	vect<> c(left+(x-0.5)*sw, bottom+(y-0.5)*sh);
+	double t = lsqr>0 ? ((c-a)*ab)/lsqr : 0;
+	t = t<0 ? 0 : (t>1 ? 1 : t);
+	if (sqr(c-(a+t*ab))<=sqr(reach)) {
+	  wallOf.push_back(w);
+	  wallCellOf.push_back(x+(secX+2)*y);
+	}
+      }
+  }
+  wallSectors.setCells((secX+2)*(secY+2)+1);
+  wallSectors.build(wallCellOf);
+  wallsDirty = false;
+}
+
+inline void Simulator::buildOverlapGrid(double R) {
+  // Cells about one particle diameter wide (R is the radius of the particle being placed, in
+  // case there are no particles yet)
+  double maxR = R;
+  int N = arraysActive ? parray.size() : particles.size();
+  if (arraysActive)
+    for (int i=0; i<N; i++) maxR = max(maxR, parray.getRadius(i));
+  else
+    for (auto P : particles) maxR = max(maxR, P->getRadius());
+  overlapGrid.setBounds(left, right, bottom, top, 2*maxR, max(1024, 4*N));
+  if (arraysActive)
+    for (int i=0; i<N; i++) overlapGrid.insert(i, parray.getPosition(i), parray.getRadius(i));
+  else {
+    overlapParticles.assign(particles.begin(), particles.end());
+    for (int i=0; i<N; i++) overlapGrid.insert(i, overlapParticles[i]->getPosition(), overlapParticles[i]->getRadius());
+  }
+  overlapDirty = false;
+}
+
+inline double Simulator::maxReach(Particle* P) {
+  return P->getType()==BACTERIA ? max(P->getRadius(), static_cast<Bacteria*>(P)->getMaxRadius()) : P->getRadius();
+}
+
+inline void Simulator::update(Particle* &P, double dt) {
   // Update particle
-  P->update(epsilon);
+  P->update(dt, &integrator);
   // Keep particles in bounds
+  keepInBounds(P);
+}
+
+template<typename T> inline void Simulator::update(vector<T*>& batch, double dt) {
+  for (auto P : batch) {
+    P->T::update(dt, &integrator); // Not a virtual call, every particle in the batch is a T
+    keepInBounds(P);
+  }
+}
+
+inline void Simulator::keepInBounds(Particle* P) {
   vect<> pos = P->getPosition();
+  if (keepInBounds(pos, P->getRadius(), P->getRandom())) P->freeze();
+  // Update the particle's position
+  P->getPosition() = pos;
+}
+
+inline void Simulator::buildBatches() {
+  passiveBatch.clear(); rtBatch.clear(); bacteriaBatch.clear();
+  for (auto P : particles)
+    switch (P->getType()) {
+    default:
+    case PASSIVE: passiveBatch.push_back(P); break;
+    case RTSPHERE: rtBatch.push_back(static_cast<RTSphere*>(P)); break;
+    case BACTERIA: bacteriaBatch.push_back(static_cast<Bacteria*>(P)); break;
+    }
+  batchesDirty = false;
+}
 
+inline bool Simulator::keepInBounds(vect<>& pos, double radius, RandomStream& random) {
+  bool reinserted = false;
+  vect<> start = pos;
   switch(xLBound) {
   default:
   case WRAP:
@@ -948,13 +1672,13 @@ inline void Simulator::update(Particle* &P) {
   case RANDOM:
     if (pos.x<0) {
       pos.x = right;
-      pos.y = (top-2*P->getRadius())*drand48()+P->getRadius();
+      pos.y = (top-2*radius)*random.next()+radius;
       int count = 0;
-      while(wouldOverlap(pos, P->getRadius()) && count<10) {
-	pos.y = (top-2*P->getRadius())*drand48()+P->getRadius();
+      while(wouldOverlap(pos, radius) && count<10) {
+	pos.y = (top-2*radius)*random.next()+radius;
 	count++;
       }
-      P->freeze();
+      reinserted = true;
     }
     break;
   case NONE: break;
@@ -968,13 +1692,13 @@ inline void Simulator::update(Particle* &P) {
   case RANDOM:
     if (pos.x>right) {
       pos.x = 0;
-      pos.y = (top-2*P->getRadius())*drand48()+P->getRadius();
+      pos.y = (top-2*radius)*random.next()+radius;
       int count = 0;
-      while(wouldOverlap(pos, P->getRadius()) && count<10) {
-        pos.y = (top-2*P->getRadius())*drand48()+P->getRadius();
+      while(wouldOverlap(pos, radius) && count<10) {
+        pos.y = (top-2*radius)*random.next()+radius;
 	count++;
       }
-      P->freeze();
+      reinserted = true;
     }
     break;
   case NONE: break;
@@ -991,15 +1715,15 @@ inline void Simulator::update(Particle* &P) {
     if (pos.y<0) {
       timeMarks.push_back(time); // Record time
       lastMark = time;
-      pos.y = yTop+4*P->getRadius()*drand48();
-      pos.x = (right-2*P->getRadius())*drand48()+P->getRadius();
+      pos.y = yTop+4*radius*random.next();
+      pos.x = (right-2*radius)*random.next()+radius;
       int count = 0;
-      while(wouldOverlap(pos, P->getRadius()) && count<10) {
-	pos.y = yTop+4*P->getRadius()*drand48();
-	pos.x = (right-2*P->getRadius())*drand48()+P->getRadius();
+      while(wouldOverlap(pos, radius) && count<10) {
+	pos.y = yTop+4*radius*random.next();
+	pos.x = (right-2*radius)*random.next()+radius;
 	count++;
       }
-      P->freeze();
+      reinserted = true;
       break;
     }
   case NONE: break;
@@ -1013,43 +1737,140 @@ inline void Simulator::update(Particle* &P) {
   case RANDOM:
     if (pos.y>top) {
       pos.y = 0;
-      pos.x = (right-2*P->getRadius())*drand48()+P->getRadius();
+      pos.x = (right-2*radius)*random.next()+radius;
       int count = 0;
-      while(wouldOverlap(pos, P->getRadius()) && count<10) {
-	pos.x = (right-2*P->getRadius())*drand48()+P->getRadius();
+      while(wouldOverlap(pos, radius) && count<10) {
+	pos.x = (right-2*radius)*random.next()+radius;
         count++;
       }
-      P->freeze();
+      reinserted = true;
     }
     break;
   case NONE: break;
   }
 
-  // Update the particle's position
-  P->getPosition() = pos;
+  // A particle that wrapped or was reinserted is far from the overlap grid cell it was put in, and
+  // the grid only allows for a particle moving one cell, so later searches would miss it
+  if (pos.x!=start.x || pos.y!=start.y) overlapDirty = true;
+  return reinserted;
+}
+
+inline void Simulator::checkpoint() {
+  if (checkpointInterval>0 && time-lastCheckpoint>=checkpointInterval) {
+    saveCheckpoint(checkpointFile);
+    lastCheckpoint = time;
+  }
 }
 
 inline void Simulator::record() {
-  // Record positions
-  watchPos.push_back(vector<vect<> >());
-  for (auto P : watchlist)
-    watchPos.at(recIt).push_back(P->getPosition());
+  if (arraysActive) parray.store();
+  // Wait until the frame we are about to fill has been processed
+  std::unique_lock<std::mutex> lock(recMutex);
+  recCond.wait(lock, [&] { return !recBusy[recNext]; });
+  bool failed = recError!=0;
+  lock.unlock();
+  if (failed) finishRecording();
+  // Snapshot the state, the reductions are done by processRecord
+  RecordFrame &frame = recFrames[recNext];
+  frame.time = time;
+  frame.statistics = statistics;
+  frame.fused = fused;
+  frame.flowFunc = flowFunc;
+  frame.maxV = maxV;
+  frame.maxF = maxF;
+  frame.vbins = vbins;
+  frame.bottom = bottom;
+  frame.top = top;
+  frame.samplePoints = samplePoints;
+  frame.secX = secX;
+  frame.secY = secY;
+  frame.keepStatRecords = keepStatRecords;
+  frame.recFields = recFields;
+  frame.view = &particles;
+  frame.resourceView = &resource;
+  frame.wasteView = &waste;
+  if (asyncRecord) {
+    // Copy each particle as its own type. Reserving first keeps the pointers into the vectors valid
+    frame.passive.clear();
+    frame.rtspheres.clear();
+    frame.bacteria.clear();
+    frame.copies.clear();
+    int nrt = 0, nbact = 0;
+    for (auto P : particles) {
+      if (P->getType()==RTSPHERE) nrt++;
+      else if (P->getType()==BACTERIA) nbact++;
+    }
+    frame.passive.reserve(particles.size()-nrt-nbact);
+    frame.rtspheres.reserve(nrt);
+    frame.bacteria.reserve(nbact);
+    for (auto P : particles) {
+      switch (P->getType()) {
+      case RTSPHERE:
+	frame.rtspheres.push_back(*static_cast<RTSphere*>(P));
+	frame.copies.push_back(&frame.rtspheres.back());
+	break;
+      case BACTERIA:
+	frame.bacteria.push_back(*static_cast<Bacteria*>(P));
+	frame.copies.push_back(&frame.bacteria.back());
+	break;
+      default:
+	frame.passive.push_back(*P);
+	frame.copies.push_back(&frame.passive.back());
+	break;
+      }
+    }
+    frame.view = &frame.copies;
+    if (recFields) {
+      static_cast<FieldBase<double>&>(frame.resource) = resource;
+      static_cast<FieldBase<double>&>(frame.waste) = waste;
+      frame.resourceView = &frame.resource;
+      frame.wasteView = &frame.waste;
+    }
+  }
+  frame.watchPos.clear();
+  frame.watchVel.clear();
+  frame.watchRad.clear();
+  for (auto P : watchlist) {
+    frame.watchPos.push_back(P->getPosition());
+    frame.watchVel.push_back(P->getVelocity());
+    frame.watchRad.push_back(P->getRadius());
+  }
+  // Hand the frame to the recording thread, or process it here
+  if (asyncRecord) {
+    if (!recThread.joinable()) recThread = std::thread(&Simulator::recordWorker, this);
+    lock.lock();
+    recBusy[recNext] = true;
+    lock.unlock();
+    recCond.notify_all();
+  }
+  else processRecord(recNext);
+  recNext = 1-recNext;
 
-  // Record statistics
-  for (int i=0; i<statistics.size(); i++)
-  statRec.at(i).push_back(vect<>(time, statistics.at(i)(particles)));
-  
-  // Record density profile //** Temporary? Find a more general way to do this?
-  profiles.push_back(getDensityYProfile());
+  // Update time
+  lastDisp = time;
+  recIt++;
+}
 
-  // Record velocity distribution
-  for (auto P : particles) {
+inline void Simulator::processRecord(int f) {
+  RecordFrame &frame = recFrames[f];
+  // Record positions
+  if (trajectory.isOpen()) {
+    trajectory.beginFrame(frame.time, frame.watchPos.size());
+    for (size_t i=0; i<frame.watchPos.size(); i++) trajectory.add(frame.watchPos[i], frame.watchVel[i], frame.watchRad[i]);
+  }
+  else watchPos.push_back(frame.watchPos);
+
+  // Record the velocity distribution, and the sums for the fused statistics, in one pass
+  bool sums = std::any_of(frame.fused.begin(), frame.fused.end(), [](sumfunc f) { return f!=0; });
+  ParticleSums S;
+  for (auto P : *frame.view) {
+    if (sums) S.add(P);
     double vel = sqrt(sqr(P->getVelocity()));
-    double fvel = sqrt(sqr(flowFunc(P->getPosition())));
-    int B = (int)(vel/maxV*vbins);
-    int Bf = fvel>0 ? (int)(vel/fvel/maxF*vbins) : vbins-1;
-    B = B>=vbins ? vbins-1 : B;
-    Bf = Bf>=vbins ? vbins-1 : Bf;
+    double fvel = frame.flowFunc ? sqrt(sqr(frame.flowFunc(P->getPosition()))) : 0; // No flow function when there is no flow
+    int B = (int)(vel/frame.maxV*frame.vbins);
+    int Bf = fvel>0 ? (int)(vel/fvel/frame.maxF*frame.vbins) : frame.vbins-1;
+    B = B>=frame.vbins ? frame.vbins-1 : B;
+    Bf = Bf>=frame.vbins ? frame.vbins-1 : Bf;
 
     try {
     velocityDistribution.at(B)++;
@@ -1057,28 +1878,68 @@ inline void Simulator::record() {
     }
     catch(...) {
 
-      cout << vel << " " << maxV << " " << fvel << endl;
+      cout << vel << " " << frame.maxV << " " << fvel << endl;
 
-      cout << B << " " << Bf << " " << vbins << endl;
+      cout << B << " " << Bf << " " << frame.vbins << endl;
       throw;
     }
   }
 
+  // Record statistics
+  for (size_t i=0; i<frame.statistics.size(); i++) {
+    double x = frame.fused[i] ? frame.fused[i](S) : frame.statistics[i](*frame.view);
+    statAcc[i].add(frame.time, x);
+    if (frame.keepStatRecords) statRec[i].push_back(vect<>(frame.time, x));
+  }
+  
+  // Record density profile //** Temporary? Find a more general way to do this?
+  profiles.push_back(densityYProfile(*frame.view, frame.samplePoints, frame.bottom, frame.top));
+
   // Record fields
-  if (recFields) {
-    resourceStr += (printResource()+',');
-    wasteStr += (printWaste()+',');
-    fitnessStr += (printFitness()+',');
+  if (frame.recFields) {
+    resourceStr += (frame.resourceView->print()+',');
+    wasteStr += (frame.wasteView->print()+',');
+    fitnessStr += (printFitness(*frame.resourceView, *frame.wasteView, frame.secX, frame.secY)+',');
   }
+}
 
-  // Update time
-  lastDisp = time;
-  recIt++;
+inline void Simulator::recordWorker() {
+  std::unique_lock<std::mutex> lock(recMutex);
+  int f = 0; // Frames are handed over alternately
+  while (true) {
+    recCond.wait(lock, [&] { return recBusy[f] || recQuit; });
+    if (!recBusy[f]) return;
+    lock.unlock();
+    try {
+      processRecord(f);
+    }
+    catch(...) {
+      lock.lock();
+      recError = std::current_exception();
+      lock.unlock();
+    }
+    lock.lock();
+    recBusy[f] = false;
+    recCond.notify_all();
+    f = 1-f;
+  }
+}
+
+void Simulator::finishRecording() {
+  std::unique_lock<std::mutex> lock(recMutex);
+  recCond.wait(lock, [&] { return !recBusy[0] && !recBusy[1]; });
+  if (recError) {
+    std::exception_ptr error = recError;
+    recError = 0;
+    std::rethrow_exception(error);
+  }
 }
 
 inline bool Simulator::inBounds(Particle* P) {
-  vect<> pos = P->getPosition();
-  double radius = P->getRadius();
+  return inBounds(P->getPosition(), P->getRadius());
+}
+
+inline bool Simulator::inBounds(vect<> pos, double radius) {
   if (pos.x+radius<0 || pos.x-radius>right) return false;
   if (pos.y+radius<0 || pos.y-radius>top) return false;
   return true;
@@ -1091,9 +1952,9 @@ void Simulator::addParticles(int N, double R, double var, double lft, double rgh
   double diffX = rght - lft - 2*R;
   double diffY = tp - bttm - 2*R;
   while (count<N && C) {
-    vect<> pos(lft+diffX*drand48()+R, bttm+diffY*drand48()+R);
+    vect<> pos(lft+diffX*getRand()+R, bttm+diffY*getRand()+R);
     if (!wouldOverlap(pos, R)) {
-      double rad = R*(1+var*drand48());
+      double rad = R*(1+var*getRand());
       Particle *P;
       switch (type) {
       default:
@@ -1132,55 +1993,396 @@ void Simulator::addRTSpheres(int N, double R, double var, double lft, double rgh
 }
 
 void Simulator::resetStatistics() {
+  finishRecording();
   for (auto &vec : statRec) vec.clear();
+  for (auto &A : statAcc) A.clear();
 }
 
 inline void Simulator::updateSectors() {
-  for (int i=0; i<(secX+2)*(secY+2)+1; i++) {
-    vector<list<Particle*>::iterator> remove;
-    for (auto p=sectors[i].begin(); p!=sectors[i].end(); ++p) {
-      int sec = getSec((*p)->getPosition());
-      if (sec != i) { // In the wrong sector
-	remove.push_back(p);
-	sectors[sec].push_back(*p);
-      }
+  // Find the sector of every particle, then counting sort them into sector order
+  unsorted.assign(particles.begin(), particles.end());
+  cellOf.resize(unsorted.size());
+  for (size_t i=0; i<unsorted.size(); i++) cellOf[i] = getSec(unsorted[i]->getPosition());
+  cells.build(cellOf);
+  cells.gather(unsorted, sectors);
+  sectorsDirty = false;
+}
+
+inline void Simulator::ppInteract() {
+  if (sectorsDirty) updateSectors();
+  int strips = numStrips();
+  bool half = useHalfStencil();
+  if (strips==0)
+    for (int y=1; y<secY+1; y++) {
+      if (half) ppHalfRow(y);
+      else ppInteractRow(y);
     }
-    // Remove particles that moved
-    for (auto P : remove) sectors[i].erase(P);
+  else // Strips of one color never share a sector row or a neighbor row, so they can run at once
+    for (int color=0; color<2; color++) {
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+      for (int s=color; s<strips; s+=2)
+	for (int y=stripStart(s, strips); y<stripStart(s+1, strips); y++) {
+	  if (half) ppHalfRow(y);
+	  else ppInteractRow(y);
+	}
+    }
+  // Have to try to interact everything in the special sector with everything else
+  if (ssecInteract) {
+    int ssec = (secX+2)*(secY+2);
+    for (int k=cells.begin(ssec); k<cells.end(ssec); k++)
+      for (auto Q : particles)
+	if (sectors[k]!=Q) sectors[k]->interact(Q);
   }
 }
 
-inline void Simulator::ppInteract() {
-  for (int y=1; y<secY+1; y++)
-    for (int x=1; x<secX+1; x++)
-      // Check in surrounding sectors
-      for (auto P : sectors[y*(secX+2)+x]) {
-	// Check surrounding sectors
-	for (int j=y-1; j<=y+1; j++) {
-	  int sy = j;
-	  if ((yBBound==WRAP || yTBound==WRAP) && j==0) sy=secY;
-	  else if ((yBBound==WRAP ||yTBound==WRAP) && j==secY+1) sy=1;
-	  for (int i=x-1; i<=x+1; i++) {
-	    int sx = i;
-	    if ((xLBound==WRAP || xRBound==WRAP) && i==0) sx=secX;
-	    else if ((xLBound==WRAP || xRBound==WRAP) && i==secX+1) sx=1;	    
-	    for (auto Q : sectors[sy*(secX+2)+sx])
-	      if (P!=Q) {
-		vect<> disp = getDisplacement(Q->getPosition(), P->getPosition());
-		P->interact(Q, disp);
-	      }
+inline void Simulator::ppInteractRow(int y) {
+  for (int x=1; x<secX+1; x++)
+    // Check in surrounding sectors
+    for (int k=cells.begin(y*(secX+2)+x); k<cells.end(y*(secX+2)+x); k++) {
+      Particle *P = sectors[k];
+      // Check surrounding sectors
+      for (int j=y-1; j<=y+1; j++) {
+	int sy = j;
+	if ((yBBound==WRAP || yTBound==WRAP) && j==0) sy=secY;
+	else if ((yBBound==WRAP ||yTBound==WRAP) && j==secY+1) sy=1;
+	for (int i=x-1; i<=x+1; i++) {
+	  int sx = i;
+	  if ((xLBound==WRAP || xRBound==WRAP) && i==0) sx=secX;
+	  else if ((xLBound==WRAP || xRBound==WRAP) && i==secX+1) sx=1;	    
+	  for (int l=cells.begin(sy*(secX+2)+sx); l<cells.end(sy*(secX+2)+sx); l++) {
+	    Particle *Q = sectors[l];
+	    if (P!=Q) P->interact(Q, getDisplacement(Q->getPosition(), P->getPosition()));
 	  }
 	}
       }
+    }
+}
+
+inline void Simulator::ppHalfRow(int y) {
+  bool wrapX = xLBound==WRAP || xRBound==WRAP, wrapY = yBBound==WRAP || yTBound==WRAP;
+  int sy = y+1;
+  if (wrapY && sy==secY+1) sy=1;
+  for (int x=1; x<secX+1; x++) {
+    int xl = x-1, xr = x+1;
+    if (wrapX && xl==0) xl=secX;
+    if (wrapX && xr==secX+1) xr=1;
+    // The right sector and the three sectors above, so every neighboring pair of sectors is visited once
+    int half[4] = {y*(secX+2)+xr, sy*(secX+2)+xl, sy*(secX+2)+x, sy*(secX+2)+xr};
+    int sec = y*(secX+2)+x;
+    for (int k=cells.begin(sec); k<cells.end(sec); k++) {
+      Particle *P = sectors[k];
+      // Particles after this one in the same sector
+      for (int l=k+1; l<cells.end(sec); l++)
+	P->pairInteract(sectors[l], getDisplacement(sectors[l]->getPosition(), P->getPosition()));
+      for (int n=0; n<4; n++)
+	for (int l=cells.begin(half[n]); l<cells.end(half[n]); l++)
+	  P->pairInteract(sectors[l], getDisplacement(sectors[l]->getPosition(), P->getPosition()));
+    }
+  }
+}
+
+inline bool Simulator::useHalfStencil() {
+  // With fewer than three sectors in a wrapped direction, the half stencil would visit some pairs twice
+  bool wrapX = xLBound==WRAP || xRBound==WRAP, wrapY = yBBound==WRAP || yTBound==WRAP;
+  return pairHalving && (!wrapX || secX>=3) && (!wrapY || secY>=3);
+}
+
+inline int Simulator::numStrips() {
+  if (nThreads<2) return 0;
+  // Strips are at least two sector rows tall so two strips of the same color are never neighbors (the half
+  // stencil writes to the row above, the full stencil only to its own row), and
+  // there is an even number of them so the first and last strip (neighbors when wrapping) differ in color
+  int strips = min(2*nThreads, secY/2);
+  strips -= strips%2;
+  return strips>=2 ? strips : 0;
+}
+
+inline int Simulator::stripStart(int s, int strips) {
+  return 1 + (s*secY)/strips;
+}
+
+inline void Simulator::verletInteract() {
+  if (verletDirty || checkVerlet()) buildVerletList();
+  // Each particle only accumulates force on itself, so the entries can be split between threads
+  int size = verletList.size();
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+  for (int i=0; i<size; i++) {
+    Particle *P = verletList[i].first;
+    for (auto Q : verletList[i].second) {
+      vect<> disp = getDisplacement(Q->getPosition(), P->getPosition());
+      P->interact(Q, disp);
+    }
+  }
+}
+
+inline bool Simulator::checkVerlet() {
+  // The lists are good as long as no two particles can have closed the skin between them, so
+  // rebuild once the largest displacement (plus any radius growth) passes half the skin depth
+  double maxMove = 0;
+  int size = verletList.size();
+#pragma omp parallel for num_threads(nThreads) schedule(static) reduction(max:maxMove)
+  for (int i=0; i<size; i++) {
+    Particle *P = verletList[i].first;
+    double move = sqrt(sqr(getDisplacement(P->getPosition(), verletPos[i])));
+    move += P->getRadius()-verletRad[i];
+    if (move>maxMove) maxMove = move;
+  }
+  return 2*maxMove>skinDepth;
+}
+
+inline void Simulator::buildVerletList() {
+  // Make sure the sectors are up to date
+  if (!sectorize || sectorsDirty) updateSectors();
+  verletList.clear();
+  verletPos.clear();
+  verletRad.clear();
+  double maxR = 0;
+  for (auto P : particles) maxR = max(maxR, P->getRadius());
+  // How many sectors away a particle within the skin can be
+  double cutoff = 2*maxR+skinDepth;
+  int reachX = static_cast<int>(ceil(cutoff*secX/(right-left)));
+  int reachY = static_cast<int>(ceil(cutoff*secY/(top-bottom)));
+  bool wrapX = xLBound==WRAP || xRBound==WRAP, wrapY = yBBound==WRAP || yTBound==WRAP;
+  // Find the sectors a center sector has to check in one dimension
+  auto stencil = [] (int c, int reach, int secs, bool wrap) {
+    vector<int> sec;
+    if (wrap && 2*reach+1>=secs) // Every sector is in range
+      for (int i=1; i<=secs; i++) sec.push_back(i);
+    else
+      for (int i=c-reach; i<=c+reach; i++) {
+	if (wrap) sec.push_back((i-1+secs)%secs+1);
+	else if (0<=i && i<=secs+1) sec.push_back(i);
+      }
+    return sec;
+  };
+  
+  for (int y=1; y<secY+1; y++) {
+    vector<int> sy = stencil(y, reachY, secY, wrapY);
+    for (int x=1; x<secX+1; x++) {
+      vector<int> sx = stencil(x, reachX, secX, wrapX);
+      for (int k=cells.begin(y*(secX+2)+x); k<cells.end(y*(secX+2)+x); k++) {
+	Particle *P = sectors[k];
+	vector<Particle*> neighbors;
+	double rP = P->getRadius()+skinDepth;
+	for (auto j : sy)
+	  for (auto i : sx)
+	    for (int l=cells.begin(j*(secX+2)+i); l<cells.end(j*(secX+2)+i); l++) {
+	      Particle *Q = sectors[l];
+	      if (P!=Q && sqr(getDisplacement(Q->getPosition(), P->getPosition()))<sqr(rP+Q->getRadius()))
+		neighbors.push_back(Q);
+	    }
+	verletList.push_back(pair<Particle*, vector<Particle*> >(P, neighbors));
+	verletPos.push_back(P->getPosition());
+	verletRad.push_back(P->getRadius());
+      }
+    }
+  }
+  // Objects in the special sector have to check against everything else
+  if (ssecInteract)
+    for (int k=cells.begin((secX+2)*(secY+2)); k<cells.end((secX+2)*(secY+2)); k++) {
+      Particle *P = sectors[k];
+      vector<Particle*> neighbors;
+      for (auto Q : particles)
+	if (P!=Q) neighbors.push_back(Q);
+      verletList.push_back(pair<Particle*, vector<Particle*> >(P, neighbors));
+      verletPos.push_back(P->getPosition());
+      verletRad.push_back(P->getRadius());
+    }
+  verletDirty = false;
+  verletRebuilds++;
+}
+
+inline void Simulator::loadArrays() {
+  parray.load(particles);
+  arraysActive = true;
+  overlapDirty = true;
+  obsValid = 0;
+}
+
+inline void Simulator::storeArrays() {
+  parray.store();
+  arraysActive = false;
+  overlapDirty = true;
+  obsValid = 0;
+  updateSectors();
+}
+
+inline void Simulator::arrayForces() {
+  int N = parray.size();
+  // Gravity
+  if (gravity!=Zero) parray.applyGravity(gravity);
+  // Flow
+  if (hasDrag) {
+    if (flowFunc) {
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+      for (int i=0; i<N; i++) parray.flowForce(i, flowFunc(parray.getPosition(i)));
+    }
+    else for (int i=0; i<N; i++) parray.flowForce(i, Zero);
+  }
+  // Particle-particle forces
+  arrayInteract();
+  // Particle-wall forces (the array cells were just sorted by arrayInteract)
+  if (!walls.empty() || !tempWalls.empty()) wallSectorInteract();
+  // Temperature causes brownian motion
+  if (temperature>0)
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+    for (int i=0; i<N; i++) {
+      vect<> F = temperature*randV(parray.getParticle(i)->getRandom()); // Each particle has its own stream
+      parray.fx[i] += F.x;
+      parray.fy[i] += F.y;
+    }
+}
+
+inline void Simulator::arrayInteract() {
+  arrayCells();
+  if (static_cast<int>(blocks.size())<nThreads) blocks.resize(nThreads);
+  int strips = numStrips();
+  bool half = useHalfStencil();
+  if (strips==0)
+    for (int y=1; y<secY+1; y++) {
+      if (half) arrayHalfRow(y);
+      else arrayInteractRow(y);
+    }
+  else // Same strip coloring as ppInteract
+    for (int color=0; color<2; color++) {
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+      for (int s=color; s<strips; s+=2)
+	for (int y=stripStart(s, strips); y<stripStart(s+1, strips); y++) {
+	  if (half) arrayHalfRow(y);
+	  else arrayInteractRow(y);
+	}
+    }
   // Have to try to interact everything in the special sector with everything else
   if (ssecInteract) {
-    for (auto P : sectors[(secX+2)*(secY+2)])
-      for (auto Q : particles)
-	if (P!=Q) {
-	  vect<> disp = getDisplacement(Q->getPosition(), P->getPosition());
-	  P->interact(Q);
+    int ssec = (secX+2)*(secY+2);
+    for (int k=cells.begin(ssec); k<cells.end(ssec); k++) {
+      int p = cells.at(k);
+      for (int q=0; q<parray.size(); q++)
+	if (p!=q) parray.interact(p, q, getDisplacement(parray.getPosition(q), parray.getPosition(p)));
+    }
+  }
+}
+
+inline void Simulator::arrayInteractRow(int y) {
+  bool wrapX = xLBound==WRAP || xRBound==WRAP, wrapY = yBBound==WRAP || yTBound==WRAP;
+  ContactBlock &block = blocks[omp_get_thread_num()];
+  for (int x=1; x<secX+1; x++)
+    for (int k=cells.begin(y*(secX+2)+x); k<cells.end(y*(secX+2)+x); k++) {
+      int p = cells.at(k);
+      vect<> pos = parray.getPosition(p);
+      if (vectorKernel) block.clear();
+      // Check surrounding sectors
+      for (int j=y-1; j<=y+1; j++) {
+	int sy = j;
+	if (wrapY && j==0) sy=secY;
+	else if (wrapY && j==secY+1) sy=1;
+	for (int i=x-1; i<=x+1; i++) {
+	  int sx = i;
+	  if (wrapX && i==0) sx=secX;
+	  else if (wrapX && i==secX+1) sx=1;
+	  for (int l=cells.begin(sy*(secX+2)+sx); l<cells.end(sy*(secX+2)+sx); l++) {
+	    int q = cells.at(l);
+	    if (p!=q) {
+	      vect<> disp = getDisplacement(parray.getPosition(q), pos);
+	      if (vectorKernel) block.add(q, disp);
+	      else parray.interact(p, q, disp);
+	    }
+	  }
 	}
+      }
+      if (vectorKernel) parray.interactBlock(p, block);
+    }
+}
+
+inline void Simulator::arrayHalfRow(int y) {
+  // Same half stencil as ppHalfRow
+  bool wrapX = xLBound==WRAP || xRBound==WRAP, wrapY = yBBound==WRAP || yTBound==WRAP;
+  int sy = y+1;
+  if (wrapY && sy==secY+1) sy=1;
+  for (int x=1; x<secX+1; x++) {
+    int xl = x-1, xr = x+1;
+    if (wrapX && xl==0) xl=secX;
+    if (wrapX && xr==secX+1) xr=1;
+    int half[4] = {y*(secX+2)+xr, sy*(secX+2)+xl, sy*(secX+2)+x, sy*(secX+2)+xr};
+    int sec = y*(secX+2)+x;
+    ContactBlock &block = blocks[omp_get_thread_num()];
+    for (int k=cells.begin(sec); k<cells.end(sec); k++) {
+      int p = cells.at(k);
+      vect<> pos = parray.getPosition(p);
+      if (vectorKernel) {
+	// Pack the candidates and hand them to the vector kernel
+	block.clear();
+	for (int l=k+1; l<cells.end(sec); l++)
+	  block.add(cells.at(l), getDisplacement(parray.getPosition(cells.at(l)), pos));
+	for (int n=0; n<4; n++)
+	  for (int l=cells.begin(half[n]); l<cells.end(half[n]); l++)
+	    block.add(cells.at(l), getDisplacement(parray.getPosition(cells.at(l)), pos));
+	parray.pairBlock(p, block);
+      }
+      else {
+	for (int l=k+1; l<cells.end(sec); l++)
+	  parray.pairInteract(p, cells.at(l), getDisplacement(parray.getPosition(cells.at(l)), pos));
+	for (int n=0; n<4; n++)
+	  for (int l=cells.begin(half[n]); l<cells.end(half[n]); l++)
+	    parray.pairInteract(p, cells.at(l), getDisplacement(parray.getPosition(cells.at(l)), pos));
+      }
+    }
+  }
+}
+
+inline bool Simulator::arraysSupported() {
+  // The adaptive stepper, and the integrators that need more than the last acceleration, work on the particles themselves
+  return !adaptive && (integrator.getType()==EULER || integrator.getType()==VELOCITY_VERLET);
+}
+
+inline void Simulator::arrayUpdates() {
+  parray.update(epsilon, integrator.getType());
+  // Keep particles in bounds
+  for (int i=0; i<parray.size(); i++) {
+    vect<> pos = parray.getPosition(i);
+    if (keepInBounds(pos, parray.getRadius(i), parray.getParticle(i)->getRandom())) parray.freeze(i);
+    parray.setPosition(i, pos);
+  }
+}
+
+inline void Simulator::arrayCells() {
+  cellOf.resize(parray.size());
+  for (int i=0; i<parray.size(); i++) cellOf[i] = getSec(parray.getPosition(i));
+  cells.build(cellOf);
+  // Move the array data into sector order, so the particles in a sector are contiguous in memory. A
+  // space filling curve reorder keeps its own order instead
+  if (reorderArrays && reorderInterval==0) {
+    parray.reorder(cells.getOrder());
+    cells.setSorted();
+    overlapDirty = true;
   }
+  // The cells now refer to the arrays, not the sorted particles
+  sectorsDirty = true;
+}
+
+inline void Simulator::reorderParticles() {
+  // Sort the array data along the curve, which moves it in memory. The particle objects cannot be
+  // moved (the watchlist and the statistics hold pointers to them), so there is nothing to sort
+  // without the arrays
+  if (!arraysActive) return;
+  vector<pair<unsigned, int> > index(parray.size());
+  for (int i=0; i<parray.size(); i++) index[i] = pair<unsigned, int>(curveKey(parray.getPosition(i)), i);
+  std::sort(index.begin(), index.end());
+  vector<int> order(parray.size());
+  for (int i=0; i<parray.size(); i++) order[i] = index[i].second;
+  parray.reorder(order);
+  sectorsDirty = true;
+  overlapDirty = true;
+  reorders++;
+}
+
+inline unsigned Simulator::curveKey(vect<> pos) {
+  // Map the simulation box onto a 2^16 by 2^16 grid
+  double fx = (pos.x-left)/(right-left), fy = (pos.y-bottom)/(top-bottom);
+  fx = fx<0 ? 0 : (fx>1 ? 1 : fx);
+  fy = fy<0 ? 0 : (fy>1 ? 1 : fy);
+  unsigned X = static_cast<unsigned>(fx*65535), Y = static_cast<unsigned>(fy*65535);
+  return reorderCurve==HILBERT ? hilbertIndex(X, Y) : mortonIndex(X, Y);
 }
 
 inline int Simulator::getSec(vect<> pos) {
@@ -1194,14 +2396,27 @@ inline int Simulator::getSec(vect<> pos) {
 }
 
 void Simulator::discard() {
+  finishRecording();
   psize = asize = 0;
-  for (int i=0; i<(secX+2)*(secY+2); i++) sectors[i].clear();
+  obsValid = 0;
+  sectors.clear();
+  passiveBatch.clear(); rtBatch.clear(); bacteriaBatch.clear();
+  batchesDirty = true;
+  cells.setCells((secX+2)*(secY+2)+1);
+  sectorsDirty = true;
+  overlapParticles.clear();
+  overlapDirty = true;
+  wallList.clear();
+  wallRadius = 0;
+  wallsDirty = true;
   for (auto P : particles) 
     if (P) {
       delete P;
       P = 0;
     }
   particles.clear();
+  verletList.clear();
+  verletDirty = true;
   watchlist.clear();
   watchPos.clear();
   for (auto W : walls) 
@@ -1219,6 +2434,7 @@ void Simulator::discard() {
   // Clear time marks and statistics
   timeMarks.clear();
   for (auto V : statRec) V.clear();
+  for (auto &A : statAcc) A.clear();
 }
 
 inline vector<vect<> > Simulator::aveProfile() {
@@ -5,14 +5,38 @@
 #define SIMULATOR_H
 
 #include "StatFunc.h"
+#include "Statistics.h"
 #include "Field.h"
+#include "ParticleArray.h"
+#include "Integrator.h"
+#include "CellList.h"
+#include "Packing.h"
+#include "Trajectory.h"
+#include "Checkpoint.h"
 #include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
 
 #include <list>
 using std::list;
 
 enum BType { WRAP, RANDOM, NONE };
-enum PType { PASSIVE, RTSPHERE, BACTERIA };
+enum CurveType { MORTON, HILBERT };
+
+/// Observables that are found together in one pass over the particles
+enum ObservableFlags { OBS_VELOCITY=1, OBS_VELOCITY_SQR=2, OBS_KE=4, OBS_MOMENTUM=8, OBS_NET_VELOCITY=16,
+		       OBS_MAX_VELOCITY=32, OBS_MAX_ACCELERATION=64, OBS_HIGHEST=128, OBS_ALL=255 };
+
+struct Observables {
+  int count;                        // Number of particles in bounds
+  double velocity, velocitySqr, KE; // Sums over the particles in bounds
+  vect<> momentum, netVelocity;     // "
+  double maxVsqr, maxAsqr;          // Largest over the particles in bounds (-1 if none)
+  double highest;                   // Highest position of any particle
+};
 
 /// The simulator class
 class Simulator {
@@ -36,6 +60,7 @@ class Simulator {
   // Accessors
   bool wouldOverlap(vect<> pos, double R);
   double getMinEpsilon() { return minepsilon; }
+  double getTimeSaved(); // Estimated wall clock time saved over fixed steps of default_epsilon (adaptive runs)
   double getDisplayTime() { return dispTime; }
   int getIter() { return iter; }
   double getRunTime() { return runTime; }
@@ -43,6 +68,13 @@ class Simulator {
   bool getDelayTriggeredExit() { return delayTriggeredExit; }
   int getSecX() { return secX; }
   int getSecY() { return secY; }
+  int getVerletRebuilds() { return verletRebuilds; } // How many times the verlet lists were built this run
+  double getVerletRebuildRate(); // Average number of iterations between verlet list rebuilds
+  int getReorders() { return reorders; } // How many times the particles were reordered this run
+  IntegratorType getIntegrator() { return integrator.getType(); }
+  double getPackPhi() { return packPhi; } // Packing fraction found by the last findPackedSolution
+  double getPackOverlap() { return packOverlap; } // Largest relative overlap left by the last findPackedSolution
+  double getNeighborDistance(); // Average distance in storage (in entries) between neighboring particles
   double getMark(int); // Accesses the value of a mark
   int getMarkSize() { return timeMarks.size(); } // Returns the number of time marks
   double getMarkSlope(); // Gets the ave rate at which marks occur (while marks are occuring)
@@ -56,6 +88,7 @@ class Simulator {
   void addStatistic(statfunc); // Adds a statistic to track
   int numStatistics() { return statistics.size(); } // Returns the number of statistics we are tracking
   vector<vect<> > getStatistic(int i); // Returns a statistic record
+  StatAccumulator& getStatSummary(int i) { return statAcc.at(i); } // Running mean, variance, etc. of a statistic
   int getPSize() { return psize; }
   int getASize() { return asize; }
   vector<double> getDensityXProfile();
@@ -66,6 +99,8 @@ class Simulator {
   double highestPosition();
   vect<> netMomentum();
   vect<> netVelocity();
+  const Observables& observe(unsigned which=OBS_ALL); // Finds every requested observable in one pass, cached until the particles change
+  void invalidateObservables() { obsValid = 0; } // Call after changing particles by hand
   vector<double> getTimeMarks() { return timeMarks; }
   vector<vect<> > getVelocityDistribution();
   vector<vect<> > getAuxVelocityDistribution();
@@ -81,10 +116,26 @@ class Simulator {
   void setDispFactor(double f) { dispFactor = f; }
   void setSectorize(bool s) { sectorize = s; }
   void setSectorDims(int sx, int sy);
+  void setVerlet(bool v) { verlet = v; verletDirty = true; }
+  void setSkinDepth(double s) { skinDepth = s; verletDirty = true; }
+  void setUseArrays(bool a) { useArrays = a; }
+  void setReorderArrays(bool r) { reorderArrays = r; } // Ignored while a curve reorder interval is set
+  void setVectorKernel(bool v) { vectorKernel = v; }
+  void setThreads(int n) { nThreads = n>0 ? n : 1; }
+  void setAsyncRecording(bool a) { finishRecording(); asyncRecord = a; } // Process recorded data on a background thread (off by default)
+  void setPairHalving(bool h) { pairHalving = h; }
+  void setReorderInterval(int i) { reorderInterval = i; } // Only reorders the particle arrays
+  void setReorderCurve(CurveType c) { reorderCurve = c; }
   void setDimensions(double left, double right, double bottom, double top);
   void setAdjustEpsilon(bool a) { adjust_epsilon = a; }
   void setDefaultEpsilon(double e) { default_epsilon = e; }
   void setMinEpsilon(double m) { min_epsilon = m; }
+  void setAdaptiveTimestep(bool a) { adaptive = a; } // Pick each step from an error estimate and the contact stiffness (off by default, pays off for dilute systems)
+  void setMaxSubsteps(int k) { maxSubsteps = k>0 ? k : 1; } // Substeps particles near contact may take in one step (1 for a single global step)
+  void setMaxEpsilon(double e) { max_epsilon = e; }
+  void setStepTolerance(double t) { stepTolerance = t; } // Position error allowed per step
+  void setIntegrator(IntegratorType t) { integrator.setType(t); }
+  void setLangevinFriction(double g) { integrator.setFriction(g); } // Friction rate of the BAOAB thermostat
   void setXLBound(BType b) { xLBound = b; }
   void setXRBound(BType b) { xRBound = b; }
   void setYTBound(BType b) { yTBound = b; }
@@ -99,6 +150,7 @@ class Simulator {
   void setDelayTime(double t) { delayTime = t; }
   void setMaxIters(int it) { maxIters = it; }
   void setRecAllIters(bool r) { recAllIters = r; }
+  void setKeepStatRecords(bool k) { keepStatRecords = k; } // If false, statistics only go to their accumulators
   void setHasDrag(bool d) { hasDrag = d; }
   void setSamplePoints(int p) { samplePoints = p; }
   void setFlowFunc(std::function<vect<>(vect<>)> f) { flowFunc = f; }
@@ -113,6 +165,7 @@ class Simulator {
   void setWasteDecayRate(double lw) { lamW = lw; }
   void setResourceDiffusion(double dr) { resourceDiffusion = dr; }
   void setWasteDiffusion(double dw) { wasteDiffusion = dw; }
+  void setSpectralDiffusion(bool s) { spectralDiffusion = s; } // Implicit (stable at any step) diffusion of the fields
   /// Global set functions
   void setParticleDissipation(double);
   void setWallDissipation(double);
@@ -129,6 +182,12 @@ class Simulator {
   void addNWParticles(int N, double R, double var, double left, double right, double bottom, double top, PType type=PASSIVE, double vmax=-1);
   void addRTSpheres(int N, double R, double var, double left, double right, double bottom, double top, vect<> bias);
   void addWatchedParticle(Particle* p);
+  void setTrajectory(string filename, bool single=false); // Stream the watchlist positions, velocities and radii to a binary file instead of keeping positions
+  double loadTrajectory(string filename, double t); // Put the watched particles where a trajectory file had them at time t (for replays), returns the frame's time
+  void closeTrajectory();
+  void saveCheckpoint(string filename); // Write the full state of the simulation to a binary file
+  void loadCheckpoint(string filename); // Restore a saved state, the next run continues from it
+  void setCheckpoint(string filename, double interval); // Save a checkpoint every interval (simulation time) while running
   vector<vect<> > findPackedSolution(int N, double R, double left, double right, double bottom, double top); // Finds where we can put particles for high packing
 
   // Display functions
@@ -164,18 +223,33 @@ class Simulator {
   inline void calculateForces(); // Gravity, flow, particle-particle, and particle-wall forces
   inline void logisticUpdates(); // Time, iteration, and data recording
   inline void objectUpdates();   // Update particles, sectors, and temp walls
-  inline void bacteriaUpdate(); 
+  inline bool bacteriaUpdate();  // Returns whether any particles were born or died
   inline void updateFields();   // Diffusion for fields
   /// Utility functions  
   inline double maxVelocity(); // Finds the maximum velocity of any particle
   inline double maxAcceleration(); // Finds the maximum acceleration of any particle
+  inline void computeObservables(unsigned); // The fused reduction behind observe
   inline vect<> getDisplacement(vect<>, vect<>);
   inline double getFitness(int, int);
 
   inline void interactions();
-  inline void update(Particle* &);
+  inline void wallInteract(); // Particle-wall and particle-temp wall forces
+  inline void wallSectorInteract(); // Wall forces, only testing the particles in the sectors near each wall
+  inline double wallContact(int w, int k); // Force between a wall and the particle at position k of the cell list
+  inline void buildWallIndex(); // Find the sectors each wall can reach
+  inline double maxReach(Particle*); // Largest radius a particle can grow to
+  inline void update(Particle* &, double);
+  template<typename T> inline void update(vector<T*>&, double); // Update a batch of particles of type T, without virtual calls
+  inline void keepInBounds(Particle*);
+  inline bool keepInBounds(vect<>&, double, RandomStream&); // Returns true if the object was reinserted (at a place drawn from the stream)
   inline void record();
+  inline void processRecord(int); // Reduce and store a snapshot
+  inline void recordWorker(); // Body of the recording thread
+  void finishRecording(); // Wait until every snapshot has been processed
+  inline vector<double> densityYProfile(list<Particle*>&, int, double, double); // Profile with the given number of bins, between bottom and top
+  inline string printFitness(Field&, Field&, int, int); // Fitness over the given number of sectors
   inline bool inBounds(Particle*);
+  inline bool inBounds(vect<>, double);
   inline void setFieldWrapping(bool, bool);
   inline void setFieldDims(int, int);
 
@@ -193,6 +267,7 @@ class Simulator {
 
   /// Bacteria
   double resourceDiffusion, wasteDiffusion;
+  bool spectralDiffusion; // Diffuse the fields implicitly, with the spectral solver
   double secretionRate, eatRate;
   double replenish, wasteSource;
   Field resource, waste, buffer;
@@ -211,6 +286,33 @@ class Simulator {
   double default_epsilon, min_epsilon;
   double minepsilon; // The smallest epsilon that was ever used
   bool adjust_epsilon;
+  Integrator integrator; // How the particles are moved each step (with BAOAB, temperature is the kT of a Langevin bath)
+
+  /// Adaptive time stepping. Particles that could touch something (or a wall) within the step are
+  /// stiff, the rest are free. Stiff particles take substeps short enough for the stiffest contact,
+  /// with their contact forces found again each substep and the other forces held over the step.
+  /// Temperature noise is applied once per step, so it does not scale with the step size.
+  /// This pays off for dilute systems, where most particles are free most of the time (see the
+  /// integrators benchmark). In dense packings nearly every particle is stiff, so the steps come
+  /// out like fixed ones and the bookkeeping only adds time, which is why it is off by default.
+  inline double adaptiveStep(); // Choose the next step, and which particles need substeps
+  inline void findStiff(double reach, int span); // Find the particles within reach of touching something, looking span sectors out
+  inline double stableStep(double k, double c, double m); // Largest stable step of a damped contact
+  inline void substepUpdates(); // Free particles take the whole step, stiff ones take substeps
+  bool adaptive;
+  int maxSubsteps, substeps; // Most substeps allowed, and how many this step uses
+  double max_epsilon, stepTolerance;
+  double stableEpsilon; // Stable step of the stiffest contact this step
+  vector<Particle*> plist; // The particles this step (in sector order if sectorizing)
+  vector<char> stiff;
+  vector<int> stiffList;
+  vector<pair<int,int> > stiffPairs;
+  vector<pair<Wall*,int> > stiffWalls;
+  vector<vect<> > slowForce; // Non-contact forces on the stiff particles, held over the substeps
+  std::unordered_map<uint64_t, pair<vect<>, int> > lastAccel; // Acceleration of each particle (by id) last step, and the substeps it took
+  double adaptiveTime; // Wall time spent choosing steps and taking extra substeps
+  double fixedSteps;   // How many steps of default_epsilon the run would have taken
+  int adaptiveSteps;
   double dispTime;   // Time between recordings (1/dispRate)
   double dispFactor; // Speed up or slow down animation (e.g. 2 -> 2x speed)
   double lastDisp;   // Last time data was recorded
@@ -233,6 +335,9 @@ class Simulator {
   /// Statistics
   vector<statfunc> statistics;
   vector<vector<vect<> > > statRec; // the vect is for {t, f(t)}
+  vector<StatAccumulator> statAcc;
+  vector<sumfunc> fused; // The statistics that can be found from one pass of sums (0 if not)
+  bool keepStatRecords;
   void resetStatistics();
   bool recAllIters;
   
@@ -256,11 +361,131 @@ class Simulator {
   /// Sectorization
   inline void updateSectors();
   inline void ppInteract(); 
+  inline void ppInteractRow(int); // Interact the particles in a row of sectors with their neighbors
+  inline void ppHalfRow(int); // Interact each pair once, using the half stencil
+  inline bool useHalfStencil(); // Whether we can use the half stencil
+  inline int numStrips(); // How many strips of sector rows to split the force phase into
+  inline int stripStart(int, int); // First sector row in a strip
   inline int getSec(vect<>);
-  list<Particle*>* sectors; // Sectors (buffer of empty sectors surrounds, extra sector for out of bounds particles [x = 0, y = secY+3])
+  CellList cells; // Sectors (buffer of empty sectors surrounds, extra sector for out of bounds particles [x = 0, y = secY+3])
+  vector<Particle*> sectors; // The particles in sector order, cells gives the range of each sector
+  vector<Particle*> unsorted; // The particles in list order, while sorting
+  vector<int> cellOf; // The sector of each particle, while sorting
+  bool sectorsDirty; // Whether particles were added or removed since the sectors were last sorted
   int secX, secY; // Width and height of sector grid
   bool sectorize; // Whether to use sector based interactions
   bool ssecInteract; // Whether objects in the special sector should interact with other objects
+  bool pairHalving; // Whether to compute each contact once and apply it to both particles
+
+  /// Type partitioned batches, so each type's update is statically dispatched. They are not used when
+  /// a boundary reinserts particles, since where a particle lands depends on which ones have moved
+  inline void buildBatches(); // Sort the particles into the batches by type
+  bool randomBounds() { return xLBound==RANDOM || xRBound==RANDOM || yTBound==RANDOM || yBBound==RANDOM; }
+  vector<Particle*> passiveBatch;
+  vector<RTSphere*> rtBatch;
+  vector<Bacteria*> bacteriaBatch;
+  bool batchesDirty; // Whether particles were added, removed, or reordered since the batches were built
+
+  /// Checkpointing
+  inline void checkpoint(); // Save a checkpoint if one is due
+  string checkpointFile; // Where to save checkpoints while running
+  double checkpointInterval; // Simulation time between checkpoints (0 for never)
+  double lastCheckpoint; // Time of the last checkpoint
+  bool resuming; // Whether the next run continues from a loaded checkpoint
+
+  /// Trajectory output
+  TrajectoryWriter trajectory; // Where to stream recorded frames (if open)
+
+  /// Packing
+  double packPhi, packOverlap; // Results of the last findPackedSolution
+
+  /// Overlap queries
+  inline void buildOverlapGrid(double); // Put the particles in the overlap grid
+  OverlapGrid overlapGrid; // Grid of the particles (or array entries), for wouldOverlap
+  vector<Particle*> overlapParticles; // The particle for each id in the overlap grid
+  bool overlapDirty; // Whether the particles have moved or changed since the grid was built
+
+  /// Wall index
+  CellList wallSectors; // Entries of wallOf, sorted by the sector they reach
+  vector<int> wallOf; // The wall (in wallList) of each entry
+  vector<int> wallCellOf; // The sector of each entry, while sorting
+  vector<Wall*> wallList; // Walls and temp walls
+  vector<double> wallPressure; // Pressure on each wall, one set per thread
+  double wallRadius; // Largest particle radius the index was built for
+  bool wallsDirty; // Whether the walls, particles, or sectors changed enough that the index must be rebuilt
+
+  /// Verlet lists
+  inline void verletInteract(); // Interact particles using the verlet lists, rebuilding them if neccessary
+  inline bool checkVerlet(); // Whether any particle has moved far enough that we must rebuild
+  inline void buildVerletList();
+  vector<pair<Particle*, vector<Particle*> > > verletList; // Each particle and the particles within its skin
+  vector<vect<> > verletPos; // Positions of the particles when the lists were last built
+  vector<double> verletRad; // Radii of the particles when the lists were last built
+  bool verlet; // Whether to use verlet lists for particle-particle interactions
+  bool verletDirty; // Whether particles were added or removed since the last build
+  double skinDepth; // Extra distance beyond contact that a pair is kept in the list
+  int verletRebuilds; // Number of times the lists have been built this run
+
+  /// Array based particle storage
+  inline void loadArrays();    // Copy the particles into the arrays and start using them
+  inline void storeArrays();   // Copy the arrays back into the particles and stop using them
+  inline void arrayForces();   // Gravity, flow, particle-particle, and particle-wall forces on the arrays
+  inline void arrayInteract(); // Particle-particle forces on the arrays
+  inline void arrayInteractRow(int);
+  inline void arrayHalfRow(int);
+  inline void arrayUpdates();  // Update the arrays and keep the particles in bounds
+  inline void arrayCells();    // Sort the array particles into sectors
+  inline bool arraysSupported(); // Whether the arrays can run with the chosen time stepping
+  ParticleArray parray;
+  bool useArrays;    // Whether runs should use the particle arrays
+  bool arraysActive; // Whether the arrays currently hold the state of the particles
+  bool reorderArrays; // Whether to move the array data into sector order when sorting
+  bool vectorKernel; // Whether to use the vectorized (blocked) contact kernels
+  vector<ContactBlock> blocks; // Candidate blocks for the vector kernels, one per thread
+
+  /// Spatial reordering
+  inline void reorderParticles(); // Sort the particle arrays along a space filling curve
+  inline unsigned curveKey(vect<>); // Position along the curve
+  int reorderInterval; // How many iterations between reorderings (0 for never)
+  CurveType reorderCurve; // Which curve to sort along
+  int reorders; // Number of reorderings this run
+
+  /// Multithreading
+  int nThreads; // Number of threads to use for the force phase (and the observables, when using arrays)
+
+  /// Cached observables
+  Observables obs;
+  unsigned obsValid; // Which of the observables are up to date
+
+  /// Asynchronous recording
+  struct RecordFrame {
+    double time;
+    vector<Particle> passive;  // Copies of the particles, kept as their own types so statfuncs can look at them
+    vector<RTSphere> rtspheres;
+    vector<Bacteria> bacteria;
+    list<Particle*> copies;  // The copies, in list order, in the form the statfuncs take
+    list<Particle*> *view;   // What to reduce: the copies, or the live particles when processing synchronously
+    vector<vect<> > watchPos, watchVel; // Watched particles
+    vector<double> watchRad;
+    Field resource, waste;   // Field snapshots (if recFields)
+    Field *resourceView, *wasteView;
+    // The settings the reductions use, so the worker never reads the simulator's
+    vector<statfunc> statistics;
+    vector<sumfunc> fused;
+    std::function<vect<>(vect<>)> flowFunc;
+    double maxV, maxF, bottom, top;
+    int vbins, samplePoints, secX, secY;
+    bool keepStatRecords, recFields;
+  };
+  RecordFrame recFrames[2]; // Double buffer: one is filled while the other is processed
+  bool recBusy[2];          // Whether a frame is waiting for or being processed by the worker
+  int recNext;              // Frame the main thread fills next
+  bool asyncRecord;         // Whether snapshots are processed on the recording thread
+  bool recQuit;             // Tells the recording thread to exit
+  std::thread recThread;
+  std::mutex recMutex;
+  std::condition_variable recCond;
+  std::exception_ptr recError; // Exception thrown while processing, rethrown on the main thread
   
   int samplePoints;
   vector<vector<double> > profiles; // For density y-profile //**
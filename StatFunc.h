@@ -3,16 +3,16 @@
 
 #include "Object.h"
 
-typedef double (*statfunc)(list<Particle*>);
+typedef double (*statfunc)(const list<Particle*>&);
 
-inline double statKE(list<Particle*> particles) {
+inline double statKE(const list<Particle*>& particles) {
   if (particles.empty()) return 0;
   double ke = 0;
   for (auto P : particles) ke += P->getKE();
   return ke/particles.size();
 }
 
-inline double statPassiveKE(list<Particle*> particles) {
+inline double statPassiveKE(const list<Particle*>& particles) {
   if (particles.empty()) return 0;
   double ke = 0;
   int p=0;
@@ -24,21 +24,21 @@ inline double statPassiveKE(list<Particle*> particles) {
   return p>0? ke/p : 0;
 }
 
-inline double statNetOmega(list<Particle*> particles){
+inline double statNetOmega(const list<Particle*>& particles){
   if (particles.empty()) return 0;
   double omega = 0;
   for (auto P : particles) omega += P->getOmega();
   return omega;
 }
 
-inline double statFlow(list<Particle*> particles) {
+inline double statFlow(const list<Particle*>& particles) {
   if (particles.empty()) return 0;
   double flow = 0;
   for (auto P : particles) flow += (vect<>(1,0)*P->getVelocity());
   return flow/particles.size();
 }
 
-inline double statPassiveFlow(list<Particle*> particles) {
+inline double statPassiveFlow(const list<Particle*>& particles) {
   if (particles.empty()) return 0;
   double flow = 0;
   int p = 0;
@@ -49,7 +49,7 @@ inline double statPassiveFlow(list<Particle*> particles) {
   return p>0 ? flow/p : 0;
 }
 
-inline double statActiveFlow(list<Particle*> particles) {
+inline double statActiveFlow(const list<Particle*>& particles) {
   if (particles.empty()) return 0;
   double flow = 0;
   int a = 0;
@@ -60,10 +60,81 @@ inline double statActiveFlow(list<Particle*> particles) {
   return a>0 ? flow/a : 0;
 }
 
-inline double statFlowRatio(list<Particle*> particles) {
+inline double statFlowRatio(const list<Particle*>& particles) {
   double aFlow = statActiveFlow(particles);
   double pFlow = statPassiveFlow(particles);
   return aFlow>0 ? pFlow/aFlow : 0;
 }
 
+/// Sums over the particles that the statistics above are made from, so all of them can be found in one pass
+struct ParticleSums {
+  ParticleSums() { clear(); }
+  void clear() {
+    passive = active = 0;
+    passiveKE = activeKE = passiveFlow = activeFlow = omega = 0;
+  }
+  void add(Particle* P) {
+    double ke = P->getKE(), flow = E0*P->getVelocity();
+    if (P->isActive()) {
+      active++;
+      activeKE += ke;
+      activeFlow += flow;
+    }
+    else {
+      passive++;
+      passiveKE += ke;
+      passiveFlow += flow;
+    }
+    omega += P->getOmega();
+  }
+  int passive, active;
+  double passiveKE, activeKE, passiveFlow, activeFlow, omega;
+};
+
+typedef double (*sumfunc)(const ParticleSums&);
+
+inline double sumKE(const ParticleSums& S) {
+  int n = S.passive+S.active;
+  return n>0 ? (S.passiveKE+S.activeKE)/n : 0;
+}
+
+inline double sumPassiveKE(const ParticleSums& S) {
+  return S.passive>0 ? S.passiveKE/S.passive : 0;
+}
+
+inline double sumNetOmega(const ParticleSums& S) {
+  return S.omega;
+}
+
+inline double sumFlow(const ParticleSums& S) {
+  int n = S.passive+S.active;
+  return n>0 ? (S.passiveFlow+S.activeFlow)/n : 0;
+}
+
+inline double sumPassiveFlow(const ParticleSums& S) {
+  return S.passive>0 ? S.passiveFlow/S.passive : 0;
+}
+
+inline double sumActiveFlow(const ParticleSums& S) {
+  return S.active>0 ? S.activeFlow/S.active : 0;
+}
+
+inline double sumFlowRatio(const ParticleSums& S) {
+  double aFlow = sumActiveFlow(S);
+  double pFlow = sumPassiveFlow(S);
+  return aFlow>0 ? pFlow/aFlow : 0;
+}
+
+/// The version of a statistic that works from the sums (0 if it needs the particles themselves)
+inline sumfunc fusedStatistic(statfunc f) {
+  if (f==statKE) return sumKE;
+  if (f==statPassiveKE) return sumPassiveKE;
+  if (f==statNetOmega) return sumNetOmega;
+  if (f==statFlow) return sumFlow;
+  if (f==statPassiveFlow) return sumPassiveFlow;
+  if (f==statActiveFlow) return sumActiveFlow;
+  if (f==statFlowRatio) return sumFlowRatio;
+  return 0;
+}
+
 #endif
@@ -0,0 +1,90 @@
+#include "Statistics.h"
+
+StatAccumulator::StatAccumulator(int maxLag) : histLow(0), histHigh(0) {
+  setMaxLag(maxLag);
+}
+
+void StatAccumulator::add(double t, double x) {
+  if (stat.n==0) {
+    minX = maxX = x;
+    firstT = t;
+  }
+  minX = min(minX, x);
+  maxX = max(maxX, x);
+  lastT = t;
+  // Products with the values k steps back (recent[head-k])
+  int L = recent.size();
+  for (int k=1; k<=L && k<=stat.n; k++) {
+    double back = recent[(head-k+L)%L];
+    lags[k-1] += x*back;
+    heads[k-1] += x;
+    tails[k-1] += back;
+  }
+  if (L>0) {
+    recent[head] = x;
+    head = (head+1)%L;
+  }
+  stat.add(x);
+  // Histogram
+  if (!histogram.empty() && histLow<=x && x<histHigh) {
+    int bin = static_cast<int>((x-histLow)/(histHigh-histLow)*histogram.size());
+    histogram[min(bin, static_cast<int>(histogram.size())-1)]++; // Rounding can put x just below histHigh in bin size()
+  }
+}
+
+void StatAccumulator::clear() {
+  stat = RunningStat();
+  minX = maxX = 0;
+  firstT = lastT = 0;
+  head = 0;
+  for (auto &x : recent) x = 0;
+  for (auto &x : lags) x = 0;
+  for (auto &x : heads) x = 0;
+  for (auto &x : tails) x = 0;
+  for (auto &x : histogram) x = 0;
+}
+
+double StatAccumulator::autocorrelation(int lag) {
+  if (lag==0) return stat.n>0 ? 1 : 0;
+  if (lag<0 || lag>static_cast<int>(lags.size()) || stat.n<=lag || stat.m2<=0) return 0;
+  double m = stat.n-lag;
+  double cov = lags[lag-1]/m - (heads[lag-1]/m)*(tails[lag-1]/m);
+  return cov/(stat.m2/stat.n);
+}
+
+vector<vect<> > StatAccumulator::getHistogram() {
+  vector<vect<> > hist;
+  double width = (histHigh-histLow)/histogram.size();
+  for (size_t i=0; i<histogram.size(); i++) hist.push_back(vect<>(histLow+(i+0.5)*width, histogram[i]));
+  return hist;
+}
+
+void StatAccumulator::setMaxLag(int L) {
+  L = L>0 ? L : 0;
+  recent = vector<double>(L, 0);
+  lags = heads = tails = vector<double>(L, 0);
+  clear();
+}
+
+void StatAccumulator::setHistogram(int bins, double low, double high) {
+  histogram = vector<double>(bins>0 && low<high ? bins : 0, 0);
+  histLow = low;
+  histHigh = high;
+  clear();
+}
+
+void StatAccumulator::save(std::ostream& out) {
+  writeBinary(out, stat); writeBinary(out, minX); writeBinary(out, maxX);
+  writeBinary(out, firstT); writeBinary(out, lastT);
+  writeBinary(out, recent); writeBinary(out, head);
+  writeBinary(out, lags); writeBinary(out, heads); writeBinary(out, tails);
+  writeBinary(out, histogram); writeBinary(out, histLow); writeBinary(out, histHigh);
+}
+
+void StatAccumulator::load(std::istream& in) {
+  readBinary(in, stat); readBinary(in, minX); readBinary(in, maxX);
+  readBinary(in, firstT); readBinary(in, lastT);
+  readBinary(in, recent); readBinary(in, head);
+  readBinary(in, lags); readBinary(in, heads); readBinary(in, tails);
+  readBinary(in, histogram); readBinary(in, histLow); readBinary(in, histHigh);
+}
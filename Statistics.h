@@ -0,0 +1,67 @@
+/// Header for Statistics.h
+/// Online accumulators for a time series of a statistic. Each value is folded in as it is recorded,
+/// so the memory used does not grow with the length of the run.
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include "Utility.h"
+#include "Checkpoint.h"
+
+/// Online mean and variance (Welford)
+struct RunningStat {
+  RunningStat() : n(0), mean(0), m2(0) {};
+  void add(double x) {
+    n++;
+    double d = x-mean;
+    mean += d/n;
+    m2 += d*(x-mean);
+  }
+  double variance() { return n>1 ? m2/(n-1) : 0; }
+  long n;
+  double mean, m2;
+};
+
+/// Mean, variance, extremes, autocorrelation (up to a maximum lag) and a histogram of a time series
+class StatAccumulator {
+ public:
+  StatAccumulator(int maxLag=0);
+
+  void add(double t, double x);
+  void clear();
+
+  // Accessors
+  long getCount() { return stat.n; }
+  double mean() { return stat.mean; }
+  double variance() { return stat.variance(); }
+  double getMin() { return minX; }
+  double getMax() { return maxX; }
+  double getFirstTime() { return firstT; }
+  double getLastTime() { return lastT; }
+  double autocorrelation(int lag); // Normalized, 1 at lag 0 (0 if not enough data)
+  int getMaxLag() { return lags.size(); }
+  vector<vect<> > getHistogram(); // {bin center, count}
+
+  // Mutators (both clear the accumulator)
+  void setMaxLag(int);
+  void setHistogram(int bins, double low, double high);
+
+  // Checkpointing
+  void save(std::ostream&);
+  void load(std::istream&);
+
+ private:
+  RunningStat stat;
+  double minX, maxX;
+  double firstT, lastT;
+  // Autocorrelation: the last values in a ring buffer, and running sums of x(t)*x(t-k)
+  vector<double> recent; // Ring buffer of the last maxLag values
+  int head;              // Where the next value goes in recent
+  vector<double> lags;   // Sum of x(t)*x(t-k) for k = 1..maxLag
+  vector<double> heads, tails; // Sums of the leading and trailing values of those products
+  // Histogram
+  vector<double> histogram;
+  double histLow, histHigh;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "Trajectory.h"
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char trjMagic[8] = {'G','F','L','O','W','T','R','J'};
+const uint32_t trjVersion = 2;
+const size_t trjHeaderSize = 8+2*sizeof(uint32_t)+4*sizeof(double)+2*sizeof(uint64_t);
+const size_t trjFramesField = 8+2*sizeof(uint32_t)+4*sizeof(double); // Where the frame count is in the header
+
+TrajectoryWriter::TrajectoryWriter() : file(0), used(0), flags(0), frames(0), offset(0), count(0) {
+  buffer.resize(1<<20);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+  close();
+}
+
+void TrajectoryWriter::open(string filename, double left, double right, double bottom, double top, unsigned f) {
+  close();
+  file = fopen(filename.c_str(), "wb");
+  if (file==0) throw BadTrajectoryFile();
+  flags = f;
+  frames = 0;
+  used = 0;
+  offset = 0;
+  count = 0;
+  frameOffsets.clear();
+  frameTimes.clear();
+  // Header
+  uint32_t version = trjVersion, flg = flags;
+  uint64_t zero = 0; // Frame count and index offset, filled in by close
+  double bounds[4] = {left, right, bottom, top};
+  put(trjMagic, 8);
+  put(&version, sizeof(version));
+  put(&flg, sizeof(flg));
+  put(bounds, sizeof(bounds));
+  put(&zero, sizeof(zero));
+  put(&zero, sizeof(zero));
+}
+
+void TrajectoryWriter::close() {
+  if (file==0) return;
+  // Write the index
+  uint64_t index = offset, nframes = frames;
+  put(frameOffsets.data(), frameOffsets.size()*sizeof(uint64_t));
+  put(frameTimes.data(), frameTimes.size()*sizeof(double));
+  flush();
+  // Go back and record the number of frames and where the index is
+  fseek(file, trjFramesField, SEEK_SET);
+  fwrite(&nframes, sizeof(nframes), 1, file);
+  fwrite(&index, sizeof(index), 1, file);
+  fclose(file);
+  file = 0;
+}
+
+void TrajectoryWriter::flush() {
+  if (file && used>0) fwrite(buffer.data(), 1, used, file);
+  used = 0;
+}
+
+void TrajectoryWriter::beginFrame(double time, int c) {
+  frameOffsets.push_back(offset);
+  frameTimes.push_back(time);
+  uint32_t header[2] = {static_cast<uint32_t>(c), 0};
+  put(&time, sizeof(time));
+  put(header, sizeof(header));
+  count = c;
+  pos.clear(); vel.clear(); rad.clear();
+  frames++;
+  if (count==0) endFrame();
+}
+
+void TrajectoryWriter::add(vect<> p, vect<> v, double r) {
+  pos.push_back(p.x);
+  pos.push_back(p.y);
+  if (flags & TRJ_VELOCITY) {
+    vel.push_back(v.x);
+    vel.push_back(v.y);
+  }
+  if (flags & TRJ_RADIUS) rad.push_back(r);
+  if (pos.size()==2*static_cast<size_t>(count)) endFrame();
+}
+
+inline void TrajectoryWriter::put(const void* data, size_t size) {
+  offset += size;
+  if (used+size>buffer.size()) flush();
+  if (size>buffer.size()) fwrite(data, 1, size, file);
+  else {
+    memcpy(&buffer[used], data, size);
+    used += size;
+  }
+}
+
+inline void TrajectoryWriter::putArray(const vector<double>& data) {
+  if (flags & TRJ_SINGLE) {
+    for (auto x : data) {
+      float v = x;
+      put(&v, sizeof(v));
+    }
+  }
+  else put(data.data(), data.size()*sizeof(double));
+}
+
+inline void TrajectoryWriter::endFrame() {
+  putArray(pos);
+  if (flags & TRJ_VELOCITY) putArray(vel);
+  if (flags & TRJ_RADIUS) putArray(rad);
+  // Keep frames 8 byte aligned so the reader can hand out pointers into the mapping
+  uint64_t zero = 0;
+  if (offset%8) put(&zero, 8-offset%8);
+}
+
+TrajectoryReader::TrajectoryReader() : data(0), size(0), version(0), flags(0), bounds{0,0,0,0} {};
+
+TrajectoryReader::~TrajectoryReader() {
+  close();
+}
+
+void TrajectoryReader::open(string filename) {
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd<0) throw BadTrajectoryFile();
+  struct stat st;
+  if (fstat(fd, &st)<0 || st.st_size<static_cast<off_t>(trjHeaderSize-sizeof(uint64_t))) {
+    ::close(fd);
+    throw BadTrajectoryFile();
+  }
+  size = st.st_size;
+  void *map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map==MAP_FAILED) throw BadTrajectoryFile();
+  data = static_cast<const char*>(map);
+  // Header
+  uint32_t flg;
+  uint64_t frames, index = 0;
+  memcpy(&version, data+8, sizeof(version));
+  memcpy(&flg, data+12, sizeof(flg));
+  memcpy(bounds, data+16, sizeof(bounds));
+  memcpy(&frames, data+trjFramesField, sizeof(frames));
+  if (memcmp(data, trjMagic, 8) || version<1 || version>trjVersion) {
+    close();
+    throw BadTrajectoryFile();
+  }
+  flags = flg;
+  if (version==1) flags &= TRJ_SINGLE;
+  else memcpy(&index, data+trjFramesField+sizeof(uint64_t), sizeof(index));
+  // Use the stored index if there is one, otherwise walk the frames
+  if (index>0 && index+frames*(sizeof(uint64_t)+sizeof(double))<=size) {
+    offsets.resize(frames);
+    times.resize(frames);
+    memcpy(offsets.data(), data+index, frames*sizeof(uint64_t));
+    memcpy(times.data(), data+index+frames*sizeof(uint64_t), frames*sizeof(double));
+  }
+  else scan(version==1 ? trjFramesField+sizeof(uint64_t) : trjHeaderSize);
+}
+
+void TrajectoryReader::close() {
+  if (data) munmap(const_cast<char*>(data), size);
+  data = 0;
+  size = 0;
+  offsets.clear();
+  times.clear();
+}
+
+TrajectoryFrame TrajectoryReader::getFrame(long frame) {
+  TrajectoryFrame F;
+  const char *start = data+offsets.at(frame);
+  uint32_t count;
+  memcpy(&F.time, start, sizeof(double));
+  memcpy(&count, start+sizeof(double), sizeof(count));
+  F.count = count;
+  F.single = flags & TRJ_SINGLE;
+  size_t pairs = 2*count*(F.single ? sizeof(float) : sizeof(double));
+  // Version 1 frames have no padding after the count
+  const char *arrays = start + sizeof(double) + (version==1 ? sizeof(uint32_t) : 2*sizeof(uint32_t));
+  F.pos = arrays;
+  arrays += pairs;
+  if (flags & TRJ_VELOCITY) {
+    F.vel = arrays;
+    arrays += pairs;
+  }
+  if (flags & TRJ_RADIUS) F.rad = arrays;
+  return F;
+}
+
+long TrajectoryReader::seek(double time) {
+  long frame = std::upper_bound(times.begin(), times.end(), time) - times.begin() - 1;
+  return frame<0 ? 0 : frame;
+}
+
+inline void TrajectoryReader::scan(size_t start) {
+  size_t scalar = flags & TRJ_SINGLE ? sizeof(float) : sizeof(double);
+  size_t perParticle = 2*scalar;
+  if (flags & TRJ_VELOCITY) perParticle += 2*scalar;
+  if (flags & TRJ_RADIUS) perParticle += scalar;
+  size_t head = version==1 ? sizeof(double)+sizeof(uint32_t) : sizeof(double)+2*sizeof(uint32_t);
+  size_t at = start;
+  while (at+head<=size) {
+    double time;
+    uint32_t count;
+    memcpy(&time, data+at, sizeof(time));
+    memcpy(&count, data+at+sizeof(double), sizeof(count));
+    size_t length = head+count*perParticle;
+    if (version>1 && length%8) length += 8-length%8;
+    if (at+length>size) break; // Incomplete last frame
+    offsets.push_back(at);
+    times.push_back(time);
+    at += length;
+  }
+}
@@ -0,0 +1,118 @@
+/// Header for Trajectory.h
+/// Binary trajectory files, written one frame at a time so recording uses constant memory,
+/// and read back through a memory map so any frame can be accessed without parsing the ones before it.
+///
+/// Layout (version 2, little endian, as written by the host):
+///   Header: char[8] "GFLOWTRJ", uint32 version, uint32 flags, double left, right, bottom, top, uint64 frames, uint64 index
+///   Frame:  double time, uint32 count, uint32 padding, then the arrays
+///             count (x,y) positions, count (vx,vy) velocities (if VELOCITY), count radii (if RADIUS)
+///           as doubles (or floats if SINGLE is set), padded to a multiple of 8 bytes
+///   Index:  at byte offset index, frames uint64 frame offsets followed by frames double times
+/// The index is written by close. Files without one (version 1, or not closed) are indexed by scanning.
+
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "Utility.h"
+#include <cstdio>
+#include <cstdint>
+
+/// Flags stored in the trajectory header
+enum TrajectoryFlags { TRJ_SINGLE = 1, TRJ_VELOCITY = 2, TRJ_RADIUS = 4 };
+
+class TrajectoryWriter {
+ public:
+  TrajectoryWriter();
+  ~TrajectoryWriter();
+
+  void open(string filename, double left, double right, double bottom, double top, unsigned flags=0);
+  void close(); // Flush, write the frame index, and close the file
+  void flush(); // Write out the buffer
+
+  // Writing frames
+  void beginFrame(double time, int count); // Must be followed by exactly count calls to add
+  void add(vect<> pos, vect<> vel=Zero, double radius=0);
+
+  // Accessors
+  bool isOpen() { return file!=0; }
+  long getFrames() { return frames; }
+  unsigned getFlags() { return flags; }
+
+  // Exception classes
+  class BadTrajectoryFile {};
+
+ private:
+  inline void put(const void* data, size_t size);
+  inline void putArray(const vector<double>& data);
+  inline void endFrame();
+
+  FILE *file;
+  vector<char> buffer; // Output buffer, written out whenever it fills
+  size_t used;         // Bytes of the buffer in use
+  unsigned flags;      // What the frames hold
+  long frames;         // Frames written
+  uint64_t offset;     // Bytes written to the file so far (including the buffer)
+  vector<uint64_t> frameOffsets; // Where each frame starts
+  vector<double> frameTimes;     // The time of each frame
+  // The frame being written, stored until it is complete
+  int count;
+  vector<double> pos, vel, rad;
+};
+
+/// A zero-copy view of one frame of a mapped trajectory file
+struct TrajectoryFrame {
+  TrajectoryFrame() : time(0), count(0), single(false), pos(0), vel(0), rad(0) {};
+
+  double time;
+  int count;
+  bool single; // Whether the arrays are float32
+
+  // Raw arrays inside the mapping (0 if the file does not store them)
+  const void *pos, *vel, *rad;
+
+  // Element accessors
+  vect<> position(int i) const { return single ? vect<>(f(pos)[2*i], f(pos)[2*i+1]) : vect<>(d(pos)[2*i], d(pos)[2*i+1]); }
+  vect<> velocity(int i) const { return vel==0 ? Zero : single ? vect<>(f(vel)[2*i], f(vel)[2*i+1]) : vect<>(d(vel)[2*i], d(vel)[2*i+1]); }
+  double radius(int i) const { return rad==0 ? 0 : single ? f(rad)[i] : d(rad)[i]; }
+
+ private:
+  static const double* d(const void* p) { return static_cast<const double*>(p); }
+  static const float* f(const void* p) { return static_cast<const float*>(p); }
+};
+
+class TrajectoryReader {
+ public:
+  TrajectoryReader();
+  ~TrajectoryReader();
+
+  void open(string filename);
+  void close();
+
+  // Accessors
+  bool isOpen() { return data!=0; }
+  long getFrames() { return offsets.size(); }
+  unsigned getFlags() { return flags; }
+  double getLeft() { return bounds[0]; }
+  double getRight() { return bounds[1]; }
+  double getBottom() { return bounds[2]; }
+  double getTop() { return bounds[3]; }
+  double getTime(long frame) { return times.at(frame); }
+  TrajectoryFrame getFrame(long frame);
+  long seek(double time); // The last frame at or before time (the first frame if time is earlier)
+
+  // Exception classes
+  class BadTrajectoryFile {};
+
+ private:
+  inline void scan(size_t start); // Build the index by walking through the frames
+
+  const char *data; // The mapped file
+  size_t size;      // Size of the mapping
+  unsigned version; // File format version
+  unsigned flags;
+  double bounds[4];
+  vector<uint64_t> offsets;
+  vector<double> times;
+};
+
+#endif
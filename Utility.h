@@ -19,8 +19,11 @@
 #include <string>
 #include <sstream>
 #include <ctime>
+#include <atomic>
 #include <functional>
 #include <random>
+#include <cstdint>
+#include <new>
 #include <omp.h>
 
 using std::vector;
@@ -37,12 +40,86 @@ using std::ostream;
 
 const double PI = 3.14159265;
 
-static std::mt19937 generator;
-static std::normal_distribution<double> distribution(0., 0.25);
+/// Counter-based random numbers (Philox4x32-10). A draw is a pure function of the seed, a stream
+/// (e.g. a particle) and a counter, so it does not depend on which thread makes it or when.
+inline void philox4x32(uint32_t c[4], uint64_t seed) {
+  uint32_t k0 = seed, k1 = seed>>32;
+  for (int r=0; r<10; r++) {
+    uint64_t p0 = static_cast<uint64_t>(0xD2511F53u)*c[0], p1 = static_cast<uint64_t>(0xCD9E8D57u)*c[2];
+    uint32_t c0 = (p1>>32)^c[1]^k0, c2 = (p0>>32)^c[3]^k1;
+    c[0] = c0; c[1] = p1; c[2] = c2; c[3] = p0;
+    k0 += 0x9E3779B9u; k1 += 0xBB67AE85u;
+  }
+}
+
+/// Uniform in [0,1), the counter-th draw of a stream
+inline double randUniform(uint64_t seed, uint64_t stream, uint64_t counter) {
+  uint32_t c[4] = {static_cast<uint32_t>(counter), static_cast<uint32_t>(counter>>32), static_cast<uint32_t>(stream), static_cast<uint32_t>(stream>>32)};
+  philox4x32(c, seed);
+  return ((static_cast<uint64_t>(c[0])<<32 | c[1])>>11)*(1./9007199254740992.);
+}
+
+/// Successive draws from one stream, the counter is the only state
+struct RandomStream {
+  RandomStream(uint64_t k=0, uint64_t s=0) : key(k), stream(s), counter(0) {};
+  double next() { return randUniform(key, stream, counter++); }
+  uint64_t key, stream, counter;
+};
+
+/// The seed new streams are keyed with (shared by every thread)
+inline std::atomic<uint64_t>& randomSeed() { static std::atomic<uint64_t> seed(0); return seed; }
+
+/// Bumped whenever the seed changes, so every thread starts its setup stream over
+inline std::atomic<uint64_t>& randomGeneration() { static std::atomic<uint64_t> generation(0); return generation; }
+
+/// Index of this thread, handed out in the order threads first draw
+inline uint64_t threadIndex() {
+  static std::atomic<uint64_t> next(0);
+  static thread_local uint64_t index = next++;
+  return index;
+}
+
+/// A thread's setup stream, and the seed generation it was keyed in. A thread seeded on its own
+/// also numbers the particles it creates itself (ownIds), starting from zero
+struct ThreadRandom {
+  RandomStream random;
+  uint64_t generation;
+  bool ownIds;
+  uint64_t nextId;
+};
+
+inline ThreadRandom& threadRandom() {
+  static thread_local ThreadRandom R = {RandomStream(randomSeed(), ~0ull-threadIndex()), randomGeneration(), false, 0};
+  if (R.generation!=randomGeneration()) {
+    R.random = RandomStream(randomSeed(), ~0ull-threadIndex());
+    R.generation = randomGeneration();
+    R.ownIds = false;
+  }
+  return R;
+}
+
+/// Stream for setup code that is not tied to a particle. Each thread draws from its own stream,
+/// keyed by the seed and the thread's index
+inline RandomStream& globalRandom() { return threadRandom().random; }
+
+/// Sets the seed for every thread, and starts their setup streams over
+inline void seedRandom(uint64_t s) {
+  randomSeed() = s;
+  randomGeneration()++;
+}
+
+/// Keys this thread's setup stream (and the particles it creates) with its own seed, and numbers
+/// its particles from zero, for independent runs side by side. Lasts until the next seedRandom
+inline void seedThreadRandom(uint64_t s) {
+  ThreadRandom& R = threadRandom();
+  R.random = RandomStream(s, ~0ull);
+  R.ownIds = true;
+  R.nextId = 0;
+}
 
 /// Random number function
 inline double getRand() { 
-  return drand48(); 
+  return globalRandom().next(); 
 }
 
 /// Precision clamp
@@ -65,6 +142,21 @@ template<typename T> inline void safe_delete(T* P) {
   }
 }
 
+/// Aligned array allocation (for arrays we want the compiler to vectorize over)
+template<typename T> inline T* aligned_new(int n, int alignment=64) {
+  void *P = 0;
+  if (posix_memalign(&P, alignment, (n>0 ? n : 1)*sizeof(T))) throw std::bad_alloc();
+  return static_cast<T*>(P);
+}
+
+/// Aligned array delete function
+template<typename T> inline void aligned_delete(T* &P) {
+  if (P) {
+    free(P);
+    P=0;
+  }
+}
+
 /// Swap function
 template<typename T> inline void swap(T &a, T &b) { 
   T t=a; a=b; b=t; 
@@ -183,7 +275,7 @@ vect(const vect<T>& V) : x(V.x), y(V.y) {};
   }
     
   static vect<> rand() {
-    return vect<>(0.5-drand48(), 0.5-drand48());
+    return vect<>(0.5-getRand(), 0.5-getRand());
   }
 
   T& operator[] (int i) {
@@ -220,11 +312,21 @@ template<typename T> inline T distSqr(const vect<T>& A, const vect<T>& B) {
   return sqr(A.x-B.x)+sqr(A.y-B.y);
 }
 
-inline vect<> randV() {
-  float a = drand48();
+inline vect<> randV(RandomStream& random) {
+  float a = random.next();
   return vect<>(sinf(2*PI*a), cosf(2*PI*a));
 }
 
+inline vect<> randV() {
+  return randV(globalRandom());
+}
+
+/// Standard normal draw (Box-Muller)
+inline double randNormal(RandomStream& random) {
+  double u = random.next(), v = random.next();
+  return sqrt(-2*log(1-u))*cos(2*PI*v);
+}
+
 template<typename T> inline std::ostream& operator<<(std::ostream& out, vector<T> lst) {
   out << "{";
   for (int i=0; i<lst.size(); i++) {
@@ -257,6 +359,38 @@ inline double average(vector<vect<>> lst) {
   return ave/lst.size();
 }
 
+/// Space filling curves (points close along the curve are close in the plane)
+// Interleave the bits of x and y (16 bits each)
+inline unsigned mortonIndex(unsigned x, unsigned y) {
+  auto spread = [] (unsigned v) {
+    v &= 0xffff;
+    v = (v | (v<<8)) & 0x00ff00ff;
+    v = (v | (v<<4)) & 0x0f0f0f0f;
+    v = (v | (v<<2)) & 0x33333333;
+    v = (v | (v<<1)) & 0x55555555;
+    return v;
+  };
+  return spread(x) | (spread(y)<<1);
+}
+
+// Distance along the Hilbert curve through a 2^bits by 2^bits grid (bits<=16)
+inline unsigned hilbertIndex(unsigned x, unsigned y, int bits=16) {
+  unsigned n = 1u<<bits, d = 0;
+  for (unsigned s=n/2; s>0; s/=2) {
+    unsigned rx = (x&s)>0, ry = (y&s)>0;
+    d += s*s*((3*rx)^ry);
+    // Rotate the quadrant
+    if (ry==0) {
+      if (rx==1) {
+	x = n-1-x;
+	y = n-1-y;
+      }
+      unsigned t = x; x = y; y = t;
+    }
+  }
+  return d;
+}
+
 // A useful typedef
 typedef pair<vect<float>, bool> vtype;
 typedef pair<int,int> ipair;
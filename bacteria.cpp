@@ -34,6 +34,7 @@ int main(int argc, char** argv) {
   bool dispProfile = false;
   bool dispAveProfile = false;
   bool recFields = true;
+  bool spectral = false;
 
   //----------------------------------------
   // Parse command line arguments
@@ -107,6 +108,12 @@ int main(int argc, char** argv) {
     stream << opt.second;
     stream >> recFields;
   }
+  opt = parser.find("spectral");
+  if (!opt.first.empty()) {
+    stream.clear();
+    stream << opt.second;
+    stream >> spectral;
+  }
   opt = parser.find("profileMap");
   if (!opt.first.empty()) {
     stream.clear();
@@ -126,7 +133,7 @@ int main(int argc, char** argv) {
   int number = Vol/(PI*sqr(radius))*phi;
   
   // Seed random number generators
-  srand48( std::time(0) );
+  seedRandom( std::time(0) );
   srand( std::time(0) );
   
   //----------------------------------------
@@ -146,6 +153,7 @@ int main(int argc, char** argv) {
   simulation.setWasteDecayRate(lamW);
   simulation.setResourceDiffusion(diffR);
   simulation.setWasteDiffusion(diffW);
+  simulation.setSpectralDiffusion(spectral);
   simulation.setEatRate(secR);
   simulation.setSecretionRate(secW);
   // -----------------
@@ -135,7 +135,7 @@ int main(int argc, char** argv) {
   int NA = number*pA, NP = number-NA;
   
   // Seed random number generators
-  srand48( std::time(0) );
+  seedRandom( std::time(0) );
   srand( std::time(0) );
   
   //----------------------------------------
@@ -176,7 +176,7 @@ int main(int argc, char** argv) {
     cout << "Print[\"Average kinetic energy\"]\nListLinePlot[aveKE,PlotRange->All,PlotStyle->Black]\n";
   }
   if (aveKE) {
-    cout << "KE=" << average(simulation.getStatistic(0)) << ";\n";
+    cout << "KE=" << simulation.getStatSummary(0).mean() << ";\n";
   }
   if (dispFlow) {
     cout << "passflow=" << simulation.getStatistic(1) << ";\n";
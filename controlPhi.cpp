@@ -1,8 +1,8 @@
-#include "Simulator.h"
+#include "Ensemble.h"
 
 #include <ctime>
 
-int main() {
+int main(int argc, char** argv) {
   // Parameters
   double width = 4.;
   double height = 2.;
@@ -12,60 +12,80 @@ int main() {
   double time = 20; // Time to run the simulation for
   int N1 = 0, N2 = 900; // Starting and ending numbers
   int steps = 20;
-  int stepSize = (N2-N1)/steps;
+  int threads = std::thread::hardware_concurrency(); // Number of simulations to run at once
+  string output = ""; // File to write the table of results to
+  int seed = std::time(0); // Seed of the first trial
+  bool check = false; // Run the sweep again on one thread, and check that the averages are the same
 
   double startRec = 3; // What time to start recording data
   double radius = 0.05;
   double rA = radius;
   double Vol = width*height;
-  
-  // Seed random number generators
-  srand48( std::time(0) );
-  srand( std::time(0) );
 
+  ArgParse parser(argc, argv);
+  parser.get("trials", trials);
+  parser.get("time", time);
+  parser.get("threads", threads);
+  parser.get("output", output);
+  parser.get("seed", seed);
+  parser.get("check", check);
+  int stepSize = (N2-N1)/steps;
+  
   //----------------------------------------
 
-  Simulator simulation;
-  
-  simulation.addStatistic(statPassiveFlow);
-  simulation.addStatistic(statActiveFlow);
-  simulation.addStatistic(statFlowRatio);
+  Ensemble ensemble;
+  ensemble.addStatistic(statPassiveFlow, "pass");
+  ensemble.addStatistic(statActiveFlow, "act");
+  ensemble.addStatistic(statFlowRatio, "xi");
+  ensemble.setDimensions(width, height);
+  ensemble.setRadius(radius);
+  ensemble.setTime(time);
+  ensemble.setStartRecording(startRec);
+  ensemble.setThreads(threads);
+  ensemble.setTrials(trials, seed);
+  ensemble.setActive(vector<double>(1, pA));
+  ensemble.setVelocity(vector<double>(1, vel));
+  vector<double> phis;
+  for (int i=0, number=N1; i<=steps; i++, number+=stepSize) phis.push_back(number*PI*sqr(radius)/Vol);
+  ensemble.setPhi(phis);
+  // Use the numbers of particles exactly (rather than recomputing them from phi)
+  ensemble.setSetup([&] (Simulator& simulation, const EnsemblePoint& P) {
+      int number = N1 + stepSize*(std::find(phis.begin(), phis.end(), P.phi)-phis.begin());
+      int NP = number*(1-pA), NA = number-NP;
+      simulation.createControlPipe(NP, NA, radius, vel, default_run_force, rA, width, height);
+    });
+  ensemble.run();
+  double runTime = ensemble.getRunTime();
 
-  simulation.setStartRecording(startRec);
-  auto start = clock();
   vector<vect<> > dataA, dataP, dataX;
-  vect<> bias(0.1, 0);
-  int number = N1;
-  for (int i=0; i<=steps; i++, number+=stepSize) {
-    double act=0, pass=0, xi=0;
-    int NP = number*(1-pA), NA = number-NP;
-    for (int i=0; i<trials; i++) {
-      // Create a new control pipe
-      simulation.createControlPipe(NP, NA, radius, vel, default_run_force, rA, width, height);
-      // Run the simulation
-      simulation.run(time);
-      // Record data
-      pass += average(simulation.getStatistic(0));
-      act += average(simulation.getStatistic(1));
-      xi += average(simulation.getStatistic(2));
-    }
-    act /= (double)trials;
-    pass /= (double)trials;
-    //xi /= (double)trials;
-    xi = pass/act;
-    double phi = number*PI*sqr(radius)/Vol;
+  for (int i=0; i<ensemble.size(); i++) {
+    double phi = ensemble.getPoint(i).phi;
+    double pass = ensemble.getResult(i, 0).mean, act = ensemble.getResult(i, 1).mean;
     dataA.push_back(vect<>(phi, act));
     dataP.push_back(vect<>(phi, pass));
-    dataX.push_back(vect<>(phi, xi));
+    dataX.push_back(vect<>(phi, pass/act));
+  }
+  if (!output.empty()) ensemble.write(output);
+
+  // Each run depends only on its seed, so the thread count should not change any average
+  double difference = 0;
+  if (check) {
+    vector<vector<double> > means(ensemble.size());
+    for (int i=0; i<ensemble.size(); i++)
+      for (int s=0; s<3; s++) means[i].push_back(ensemble.getResult(i, s).mean);
+    ensemble.setThreads(1);
+    ensemble.run();
+    for (int i=0; i<ensemble.size(); i++)
+      for (int s=0; s<3; s++) difference = max(difference, fabs(ensemble.getResult(i, s).mean-means[i][s]));
   }
-  auto end = clock();
 
   cout << "Varies packing ratio\n";
   cout << "Trials: " << trials << ", Trial time: " << time << endl;
   cout << "Percent active: " << pA*100 << "%\n"; 
   cout << "Pipe width, height: " << width << ", " << height << endl;
   cout << "Radius: " << radius << ", Ra = " << rA << endl;
-  cout << "Time: " << (double)(end-start)/CLOCKS_PER_SEC << endl;
+  cout << "Time: " << runTime << ", Threads: " << threads << endl;
+  if (check) cout << "Largest difference from one thread: " << difference << (difference==0 ? " (identical)" : "") << endl;
 
   // Print list of data
   cout << "act=" << dataA << ";\n";
@@ -13,9 +13,28 @@ int main(int argc, char** argv) {
   double pA = 0.;        // What percent of the particles are active
   double activeF = 0.25; // Active force (default is 5)
   int samplePoints = -1; // How many bins we should use when making a density profile
+  bool verlet = false;   // Whether to use verlet lists
+  double skin = -1;      // Verlet list skin depth (negative -> use the default)
+  bool arrays = false;   // Whether to run using the particle arrays
+  bool vector = false;   // Whether to use the vectorized contact kernels (with -arrays)
+  int threads = 1;       // Number of threads to use for the force phase
+  bool halving = true;   // Whether to compute each contact once for both particles
+  int reorder = 0;       // Iterations between reordering the particle arrays along a space filling curve (0 -> never)
+  bool morton = false;   // Reorder along a Morton curve instead of a Hilbert curve
+  bool adaptive = false; // Whether to choose the time step adaptively
+  int substeps = 8;      // Most substeps particles near contact may take per step (with -adaptive)
+  string integrator = "euler"; // euler, verlet, gear, or baoab
+  bool async = false;    // Process the recorded data on a background thread
 
   // Display parameters
   bool animate = false;
+  string trajectory = ""; // File to stream the positions to (binary)
+  bool single = false;    // Write the trajectory with float32 coordinates
+  string replay = "";     // Trajectory file to take the starting positions from
+  double replayTime = 0;  // Time in the replay file to start from
+  string checkpoint = ""; // File to save checkpoints to
+  double checkpointInterval = 30; // Simulation time between checkpoints
+  string restore = "";    // Checkpoint to continue from
   bool dispKE = false;
   bool aveKE = false;
   bool dispFlow = false;
@@ -39,7 +58,26 @@ int main(int argc, char** argv) {
   parser.get("active", pA);
   parser.get("force", activeF);
   parser.get("points", samplePoints);
+  parser.get("verlet", verlet);
+  parser.get("skin", skin);
+  parser.get("arrays", arrays);
+  parser.get("vector", vector);
+  parser.get("threads", threads);
+  parser.get("halving", halving);
+  parser.get("reorder", reorder);
+  parser.get("morton", morton);
+  parser.get("adaptive", adaptive);
+  parser.get("substeps", substeps);
+  parser.get("integrator", integrator);
+  parser.get("async", async);
   parser.get("animate", animate);
+  parser.get("trajectory", trajectory);
+  parser.get("single", single);
+  parser.get("replay", replay);
+  parser.get("replayTime", replayTime);
+  parser.get("checkpoint", checkpoint);
+  parser.get("checkpointInterval", checkpointInterval);
+  parser.get("restore", restore);
   parser.get("dispKE", dispKE);
   parser.get("aveKE", aveKE);
   parser.get("flow", dispFlow);
@@ -55,7 +93,7 @@ int main(int argc, char** argv) {
   int NA = number*pA, NP = number-NA;
   
   // Seed random number generators
-  srand48( std::time(0) );
+  seedRandom( std::time(0) );
   srand( std::time(0) );
   
   //----------------------------------------
@@ -68,6 +106,25 @@ int main(int argc, char** argv) {
   simulation.setStartRecording(start);
   simulation.createControlPipe(NP, NA, radius, velocity, activeF, rA, width, height);
   if (samplePoints>0) simulation.setSamplePoints(samplePoints);
+  simulation.setVerlet(verlet);
+  if (skin>=0) simulation.setSkinDepth(skin);
+  simulation.setUseArrays(arrays);
+  simulation.setVectorKernel(vector);
+  simulation.setThreads(threads);
+  simulation.setPairHalving(halving);
+  simulation.setReorderInterval(reorder);
+  if (morton) simulation.setReorderCurve(MORTON);
+  simulation.setAdaptiveTimestep(adaptive);
+  simulation.setMaxSubsteps(substeps);
+  simulation.setAsyncRecording(async);
+  if (integrator=="verlet") simulation.setIntegrator(VELOCITY_VERLET);
+  else if (integrator=="gear") simulation.setIntegrator(GEAR);
+  else if (integrator=="baoab") simulation.setIntegrator(BAOAB);
+  if (!restore.empty()) simulation.loadCheckpoint(restore);
+  if (!replay.empty()) simulation.loadTrajectory(replay, replayTime);
+  if (!checkpoint.empty()) simulation.setCheckpoint(checkpoint, checkpointInterval);
+  if (!trajectory.empty()) simulation.setTrajectory(trajectory, single);
+  double neighborStart = simulation.getNeighborDistance();
   simulation.run(time);
   auto end_t = clock();
   
@@ -76,13 +133,18 @@ int main(int argc, char** argv) {
   cout << "Radius: " << radius << "\n";
   cout << "Fluid Velocity: " << velocity << "\n";
   cout << "Phi: " << phi << ", Number: " << number << ", (Actual Phi: " << number*PI*sqr(radius)/(width*height) << ")\n";
+  cout << "Packing: Phi " << simulation.getPackPhi() << ", Max overlap " << simulation.getPackOverlap() << "\n";
   cout << "Percent Active: " << pA*100 << "%, (Actual %: " << 100.*NA/(double)(NA+NP) << ")\n";
   if (NA>0) cout << "Active Force: " << activeF << endl;
   cout << "N Active: " << NA << ", N Passive: " << NP << "\n";
   cout << "Sim Time: " << time << ", Run time: " << simulation.getRunTime() << ", Ratio: " << time/simulation.getRunTime() << endl;
   cout << "Start Time: " << start << "\n";
   cout << "Actual (total) program run time: " << (double)(end_t-start_t)/CLOCKS_PER_SEC << "\n";
-  cout << "Iters: " << simulation.getIter() << "\n\n";
+  cout << "Iters: " << simulation.getIter() << ", Threads: " << threads << "\n";
+  if (adaptive) cout << "Smallest step: " << simulation.getMinEpsilon() << ", Estimated time saved over fixed steps: " << simulation.getTimeSaved() << " s\n";
+  if (verlet) cout << "Verlet rebuilds: " << simulation.getVerletRebuilds() << ", Iters per rebuild: " << simulation.getVerletRebuildRate() << "\n";
+  cout << "Neighbor memory distance: " << neighborStart << " (start), " << simulation.getNeighborDistance() << " (end), Reorders: " << simulation.getReorders() << "\n";
+  cout << "\n";
   cout << "Command: ";
   for (int i=0; i<argc; i++) cout << argv[i] << " ";
   cout << "\n-------------------------------------\n";
@@ -99,7 +161,7 @@ int main(int argc, char** argv) {
     cout << "Print[\"Average kinetic energy\"]\nListLinePlot[aveKE,PlotRange->All,PlotStyle->Black]\n";
   }
   if (aveKE) {
-    cout << "KE=" << average(simulation.getStatistic(0)) << ";\n";
+    cout << "KE=" << simulation.getStatSummary(0).mean() << ";\n";
   }
   if (dispFlow) {
     cout << "passflow=" << simulation.getStatistic(1) << ";\n";
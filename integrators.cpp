@@ -0,0 +1,94 @@
+#include "Simulator.h"
+
+/// Energy drift benchmark for the integrators, on an ideal gas with no dissipation. For each scheme and
+/// step size, reports the drift in the kinetic energy (the mean over the last tenth of the run against
+/// the first tenth) and the run time. BAOAB is run with a temperature instead, and reports how close
+/// the gas comes to equipartition (3/2 kT per particle, with the rotation). Last, the gas is run with
+/// the adaptive step, where most particles are free most of the time
+
+int main(int argc, char** argv) {
+  // Parameters
+  int number = 100;       // Number of particles
+  double radius = 0.02;   // Particle radius
+  double velocity = 1.;   // Largest initial speed
+  double time = 10.;      // How long each run lasts
+  double tolerance = 0.01; // Drift that counts as stable
+  double kT = 0.1;        // Temperature of the BAOAB runs
+  double friction = default_langevin_friction;
+
+  //----------------------------------------
+  // Parse command line arguments
+  //----------------------------------------
+  ArgParse parser(argc, argv);
+  parser.get("number", number);
+  parser.get("radius", radius);
+  parser.get("velocity", velocity);
+  parser.get("time", time);
+  parser.get("tolerance", tolerance);
+  parser.get("kT", kT);
+  parser.get("friction", friction);
+
+  vector<double> steps = {1e-5, 2e-5, 5e-5, 1e-4, 2e-4, 5e-4, 1e-3};
+  vector<pair<IntegratorType, string> > schemes = {{EULER, "Euler"}, {VELOCITY_VERLET, "Verlet"}, {GEAR, "Gear"}};
+
+  // Mean of a statistic record between two fractions of the run
+  auto window = [] (const vector<vect<> >& rec, double from, double to) {
+    double sum = 0;
+    int n = 0;
+    for (int i=from*rec.size(); i<to*rec.size(); i++, n++) sum += rec[i].y;
+    return n>0 ? sum/n : 0;
+  };
+  // Set up the gas the same way every time
+  auto gas = [&] (Simulator& simulation, IntegratorType type, double step) {
+    seedRandom(0);
+    simulation.createIdealGas(number, radius, velocity);
+    simulation.setParticleDissipation(0);
+    simulation.setDefaultEpsilon(step);
+    simulation.setMinEpsilon(step);
+    simulation.setIntegrator(type);
+    simulation.setLangevinFriction(friction);
+    simulation.setDispRate(100);
+    simulation.addStatistic(statKE);
+  };
+
+  cout << "Ideal gas, " << number << " particles, radius " << radius << ", " << time << " s\n";
+  cout << "Drift: relative change in the mean KE (first tenth to last tenth)\n\n";
+  for (auto scheme : schemes) {
+    double largest = 0;
+    cout << scheme.second << ":\n";
+    for (auto step : steps) {
+      Simulator simulation;
+      gas(simulation, scheme.first, step);
+      simulation.run(time);
+      auto rec = simulation.getStatistic(0);
+      double first = window(rec, 0, 0.1), last = window(rec, 0.9, 1.);
+      double drift = first>0 ? (last-first)/first : 0;
+      bool stable = fabs(drift)<tolerance; // False for NaN too
+      if (stable) largest = step;
+      cout << "  Step " << step << ": Drift " << drift << ", Run time " << simulation.getRunTime() << " s" << (stable ? "" : " (unstable)") << "\n";
+    }
+    cout << "  Largest step within tolerance: " << largest << "\n\n";
+  }
+
+  cout << "BAOAB, kT = " << kT << ", friction " << friction << "\n";
+  cout << "Ratio: mean KE per particle over the second half, over 3/2 kT\n";
+  for (auto step : steps) {
+    Simulator simulation;
+    gas(simulation, BAOAB, step);
+    simulation.setTemperature(kT);
+    simulation.run(time);
+    double ratio = window(simulation.getStatistic(0), 0.5, 1.)/(1.5*kT);
+    cout << "  Step " << step << ": Ratio " << ratio << ", Run time " << simulation.getRunTime() << " s\n";
+  }
+
+  cout << "\nAdaptive steps (Euler, contacts substepped)\n";
+  Simulator simulation;
+  gas(simulation, EULER, 1e-5);
+  simulation.setAdaptiveTimestep(true);
+  simulation.run(time);
+  auto rec = simulation.getStatistic(0);
+  double first = window(rec, 0, 0.1), last = window(rec, 0.9, 1.);
+  cout << "  Drift " << (first>0 ? (last-first)/first : 0) << ", Run time " << simulation.getRunTime() << " s, Steps " << simulation.getIter() << "\n";
+  
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include "ParticleArray.h"
+#include "CellList.h"
+
+/// Micro-benchmark for the contact kernels: scalar (interact, pairInteract) against the
+/// vectorized blocks (interactBlock, pairBlock), in candidate pairs per second
+
+int main(int argc, char** argv) {
+  // Parameters
+  int number = 10000;   // Number of particles
+  double radius = 0.05; // Particle radius
+  double phi = 0.8;     // Packing density (the particles are placed randomly, so they overlap)
+  int reps = 20;        // How many times to evaluate every pair
+
+  //----------------------------------------
+  // Parse command line arguments
+  //----------------------------------------
+  ArgParse parser(argc, argv);
+  parser.get("number", number);
+  parser.get("radius", radius);
+  parser.get("phi", phi);
+  parser.get("reps", reps);
+
+  // Place the particles in a square box with the requested density
+  double width = sqrt(number*PI*sqr(radius)/phi);
+  seedRandom(0);
+  list<Particle*> particles;
+  for (int i=0; i<number; i++) {
+    Particle *P = new Particle(vect<>(width*getRand(), width*getRand()), radius*(0.8+0.4*getRand()));
+    P->setVelocity(0.1*randV());
+    particles.push_back(P);
+  }
+  ParticleArray parray;
+  parray.load(particles);
+
+  // Find the candidates of each particle with a cell list, cells one particle diameter wide
+  int cells = max(1, static_cast<int>(width/(2.4*radius)));
+  vector<int> cellOf(number);
+  for (int i=0; i<number; i++) {
+    vect<> pos = parray.getPosition(i);
+    int x = min(cells-1, static_cast<int>(pos.x/width*cells)), y = min(cells-1, static_cast<int>(pos.y/width*cells));
+    cellOf[i] = x + cells*y;
+  }
+  CellList grid;
+  grid.setCells(cells*cells);
+  grid.build(cellOf);
+  vector<ContactBlock> full(number), half(number);
+  long fullPairs = 0, halfPairs = 0, contacts = 0;
+  for (int i=0; i<number; i++) {
+    int x = cellOf[i]%cells, y = cellOf[i]/cells;
+    for (int sy=max(0,y-1); sy<=min(cells-1,y+1); sy++)
+      for (int sx=max(0,x-1); sx<=min(cells-1,x+1); sx++)
+	for (int k=grid.begin(sx+cells*sy); k<grid.end(sx+cells*sy); k++) {
+	  int j = grid.at(k);
+	  if (j==i) continue;
+	  vect<> disp = parray.getPosition(j)-parray.getPosition(i);
+	  full[i].add(j, disp);
+	  if (j>i) half[i].add(j, disp);
+	  if (sqr(disp)<sqr(parray.getRadius(i)+parray.getRadius(j))) contacts++;
+	}
+    fullPairs += full[i].size();
+    halfPairs += half[i].size();
+  }
+
+  // Time a kernel, returning the forces it leaves in the arrays
+  auto timeKernel = [&] (std::function<void()> kernel, double &seconds) {
+    for (int i=0; i<number; i++) parray.fx[i] = parray.fy[i] = parray.tq[i] = 0;
+    double start = omp_get_wtime();
+    for (int r=0; r<reps; r++) kernel();
+    seconds = omp_get_wtime()-start;
+    vector<double> F;
+    for (int i=0; i<number; i++) {
+      F.push_back(parray.fx[i]);
+      F.push_back(parray.fy[i]);
+      F.push_back(parray.tq[i]);
+    }
+    return F;
+  };
+  // Largest difference between two force sets, relative to the largest force
+  auto difference = [] (const vector<double>& A, const vector<double>& B) {
+    double diff = 0, scale = 0;
+    for (size_t i=0; i<A.size(); i++) {
+      diff = max(diff, fabs(A[i]-B[i]));
+      scale = max(scale, fabs(A[i]));
+    }
+    return scale>0 ? diff/scale : diff;
+  };
+
+  double tScalar, tBlock, tPair, tPairBlock;
+  auto scalar = timeKernel([&] () {
+      for (int i=0; i<number; i++)
+	for (int k=0; k<full[i].size(); k++)
+	  parray.interact(i, full[i].index[k], vect<>(full[i].dx[k], full[i].dy[k]));
+    }, tScalar);
+  auto block = timeKernel([&] () {
+      for (int i=0; i<number; i++) parray.interactBlock(i, full[i]);
+    }, tBlock);
+  auto paired = timeKernel([&] () {
+      for (int i=0; i<number; i++)
+	for (int k=0; k<half[i].size(); k++)
+	  parray.pairInteract(i, half[i].index[k], vect<>(half[i].dx[k], half[i].dy[k]));
+    }, tPair);
+  auto pairBlock = timeKernel([&] () {
+      for (int i=0; i<number; i++) parray.pairBlock(i, half[i]);
+    }, tPairBlock);
+
+  cout << "Particles: " << number << ", Box: " << width << " x " << width << ", Cells: " << cells << " x " << cells << "\n";
+  cout << "Candidate pairs: " << fullPairs << " (one sided), " << halfPairs << " (halved), In contact: " << contacts << "\n";
+  cout << "interact:      " << reps*fullPairs/tScalar << " pairs/sec\n";
+  cout << "interactBlock: " << reps*fullPairs/tBlock << " pairs/sec, Speedup: " << tScalar/tBlock << ", Difference: " << difference(scalar, block) << "\n";
+  cout << "pairInteract:  " << reps*halfPairs/tPair << " pairs/sec\n";
+  cout << "pairBlock:     " << reps*halfPairs/tPairBlock << " pairs/sec, Speedup: " << tPair/tPairBlock << ", Difference: " << difference(paired, pairBlock) << "\n";
+
+  for (auto P : particles) delete P;
+  return 0;
+}
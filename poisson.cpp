@@ -0,0 +1,181 @@
+#include "Field.h"
+#include "MAC.h"
+
+/// Benchmark for the Poisson solvers. First a field with fixed edges and a random source, solved with
+/// SOR and with multigrid cycles, plain and preconditioning conjugate gradient, for a range of grid
+/// sizes. Then fields with no locks, wrapped and with insulating edges, solved with multigrid and with
+/// the spectral solver. Then a lid driven cavity, open, with walls, and split in two by a wall while
+/// running, with the pressure solved by SOR, plain multigrid cycles and conjugate gradient, reporting the time per step, the iterations per pressure solve and the
+/// divergence left in the velocity field. Last, the cavity with the bounds checked kernels against the
+/// fast ones
+
+/// The cavity, with access to the velocity field
+class Cavity : public MAC {
+ public:
+  Cavity(int n) : MAC(n,n) {};
+
+  // Largest divergence of the velocity field, in units of velocity per cell. The accessors are
+  // inlined into MAC.cpp, so this reads the arrays directly
+  double divergence() {
+    double maxDiv = 0;
+    for (int y=1; y<ny+1; y++)
+      for (int x=1; x<nx+1; x++) {
+        if (_P_bdd[x+(nx+2)*y]) continue;
+        double div = _U[x+(nx+1)*y]-_U[x-1+(nx+1)*y] + _V[x+(nx+2)*y]-_V[x+(nx+2)*(y-1)];
+        maxDiv = max(maxDiv, fabs(div));
+      }
+    return maxDiv;
+  }
+
+  // Largest difference in velocity or pressure from another cavity of the same size
+  double difference(const Cavity& c) {
+    double diff = 0;
+    for (int i=0; i<(nx+1)*(ny+2); i++) diff = max(diff, fabs(_U[i]-c._U[i]));
+    for (int i=0; i<(nx+2)*(ny+1); i++) diff = max(diff, fabs(_V[i]-c._V[i]));
+    for (int i=0; i<(nx+2)*(ny+2); i++) diff = max(diff, fabs(_P[i]-c._P[i]));
+    return diff;
+  }
+};
+
+int main(int argc, char** argv) {
+  // Parameters
+  int steps = 50;         // Steps of the cavity flow
+  int sorIters = 20000;   // Iteration limit for SOR on the field
+  double tolerance = 1e-6; // Relative residual for the multigrid field solves
+
+  //----------------------------------------
+  // Parse command line arguments
+  //----------------------------------------
+  ArgParse parser(argc, argv);
+  parser.get("steps", steps);
+  parser.get("sorIters", sorIters);
+  parser.get("tolerance", tolerance);
+
+  vector<int> sizes = {32, 64, 128, 256, 512};
+
+  cout << "Field with fixed edges and a random source\n";
+  for (auto n : sizes) {
+    FieldBase<double> source(n,n), field(n,n);
+    seedRandom(0);
+    for (int y=0; y<n; y++)
+      for (int x=0; x<n; x++) source(x,y) = getRand()-0.5;
+    auto setUp = [&] () {
+      field.setWrap(false, false);
+      field.useLocks();
+      field.setAll(0);
+      for (int e=0; e<4; e++) field.setEdge(e, e==0 ? 1 : 0);
+    };
+    cout << "  " << n << "x" << n << ":";
+    // SOR
+    if (n<=256) {
+      setUp();
+      field.setTollerance(1e-12);
+      field.setMaxIters(sorIters);
+      clock_t start = clock();
+      field.SOR_solver(source);
+      cout << " SOR " << (double)(clock()-start)/CLOCKS_PER_SEC << " s;";
+    }
+    // Multigrid, accelerated and stand alone
+    const char *names[] = {"V-PCG", "W-PCG", "V", "W"};
+    for (int c=0; c<4; c++) {
+      setUp();
+      field.setTollerance(tolerance);
+      field.setMaxIters(200);
+      field.setCycleType(c%2==0 ? V_CYCLE : W_CYCLE);
+      field.setAccelerate(c<2);
+      clock_t start = clock();
+      field.MG_solver(source);
+      cout << " " << names[c] << " " << field.getCycles() << " cycles, " << (double)(clock()-start)/CLOCKS_PER_SEC << " s;";
+    }
+    cout << endl;
+  }
+
+  cout << "\nFields with no locks, multigrid against spectral\n";
+  for (auto n : {30, 64, 100, 128, 250, 256, 500, 512}) {
+    cout << "  " << n << "x" << n << ":";
+    for (int wrap=1; wrap>=0; wrap--) {
+      Field source(n,n), field(n,n);
+      source.setWrap(wrap, wrap);
+      field.setWrap(wrap, wrap);
+      seedRandom(0);
+      for (int y=0; y<n; y++)
+        for (int x=0; x<n; x++) source(x,y) = getRand()-0.5;
+      field.setTollerance(tolerance);
+      clock_t start = clock();
+      field.MG_solver(source);
+      double mg = (double)(clock()-start)/CLOCKS_PER_SEC;
+      start = clock();
+      field.spectralSolver(source);
+      double spectral = (double)(clock()-start)/CLOCKS_PER_SEC;
+      cout << (wrap ? " Wrapped:" : " Insulated:") << " multigrid " << mg << " s, spectral " << spectral << " s;";
+    }
+    cout << endl;
+  }
+
+  struct Solver {
+    string name;
+    PressureSolver solver;
+    Preconditioner preconditioner;
+  };
+  vector<Solver> solvers = {{"SOR", SOR_PRESSURE, JACOBI_PRECONDITIONER},
+                            {"Multigrid", MULTIGRID_PRESSURE, JACOBI_PRECONDITIONER},
+                            {"PCG-Jacobi", PCG_PRESSURE, JACOBI_PRECONDITIONER},
+                            {"PCG-MIC", PCG_PRESSURE, INCOMPLETE_CHOLESKY_PRECONDITIONER},
+                            {"PCG-MG", PCG_PRESSURE, MULTIGRID_PRECONDITIONER}};
+  vector<string> layouts = {"", " with walls", " split in two while running"};
+  for (int walls=0; walls<3; walls++) {
+    cout << "\nLid driven cavity" << layouts[walls] << ", " << steps << " steps\n";
+    for (auto n : sizes) {
+      if (n>256) break;
+      cout << "  " << n << "x" << n << ":\n";
+      for (auto& s : solvers) {
+        Cavity cavity(n);
+        cavity.setUN(1);
+        if (walls==1) { // A baffle hanging from the lid and a shelf across the lower half
+          cavity.createWallBC(vect<>(0.5,0.35), vect<>(0.5,0.99));
+          cavity.createWallBC(vect<>(0.1,0.3), vect<>(0.7,0.3));
+        }
+        cavity.setPressureSolver(s.solver);
+        cavity.setPreconditioner(s.preconditioner);
+        double iters = 0;
+        clock_t start = clock();
+        for (int i=0; i<steps; i++) {
+          // Close off the bottom of the cavity once the fluid is moving, so each side keeps some flux
+          if (walls==2 && i==steps/5) cavity.createWallBC(vect<>(0,0.3), vect<>(1,0.3));
+          cavity.update(cavity.getEpsilon());
+          iters += cavity.getPressureIters();
+        }
+        double time = (double)(clock()-start)/CLOCKS_PER_SEC;
+        cout << "    " << s.name << ": " << iters/steps << " iters, " << time/steps*1000 << " ms/step";
+        // Next to a wall, correct() pushes the velocity through the wall face, so the divergence there
+        // is not what the solver left
+        if (!walls) cout << ", divergence " << cavity.divergence();
+        if (s.solver!=SOR_PRESSURE) cout << ", residual " << cavity.getPressureResidual();
+        cout << endl;
+      }
+    }
+  }
+
+  cout << "\nCavity kernels with SOR, bounds checked against fast, " << steps << " steps\n";
+  for (int walls=0; walls<2; walls++)
+    for (auto n : sizes) {
+      if (n>256) break;
+      Cavity checked(n), fast(n);
+      double time[2];
+      for (int f=0; f<2; f++) {
+        Cavity& cavity = f ? fast : checked;
+        cavity.setUN(1);
+        if (walls) {
+          cavity.createWallBC(vect<>(0.5,0.35), vect<>(0.5,0.99));
+          cavity.createWallBC(vect<>(0.1,0.3), vect<>(0.7,0.3));
+        }
+        cavity.setFastKernels(f);
+        clock_t start = clock();
+        for (int i=0; i<steps; i++) cavity.update(cavity.getEpsilon());
+        time[f] = (double)(clock()-start)/CLOCKS_PER_SEC;
+      }
+      cout << "  " << n << "x" << n << (walls ? " with walls" : "") << ": checked " << time[0]/steps*1000 << " ms/step, fast " << time[1]/steps*1000 << " ms/step, difference " << checked.difference(fast) << endl;
+    }
+
+  return 0;
+}